@@ -0,0 +1,46 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "arena.h"
+
+#include <algorithm>
+
+
+
+// -----------------------------------------------------------------------------
+Arena::Arena(size_t chunk)
+  : chunk_(chunk)
+  , ptr_(nullptr)
+  , end_(nullptr)
+  , size_(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+void *Arena::Allocate(size_t size, size_t align)
+{
+  uintptr_t ptr = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1);
+  if (!ptr_ || ptr + size > reinterpret_cast<uintptr_t>(end_)) {
+    // Oversized requests get a chunk of their own.
+    const size_t len = std::max(chunk_, size + align);
+    chunks_.emplace_back(new uint8_t[len]);
+    ptr_ = chunks_.back().get();
+    end_ = ptr_ + len;
+    ptr = (reinterpret_cast<uintptr_t>(ptr_) + align - 1) & ~(align - 1);
+  }
+
+  ptr_ = reinterpret_cast<uint8_t *>(ptr + size);
+  size_ += size;
+  return reinterpret_cast<void *>(ptr);
+}
+
+// -----------------------------------------------------------------------------
+void Arena::Reset()
+{
+  if (chunks_.empty()) {
+    return;
+  }
+  chunks_.erase(chunks_.begin(), chunks_.end() - 1);
+  ptr_ = chunks_.back().get();
+  size_ = 0;
+}
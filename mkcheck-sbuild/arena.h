@@ -0,0 +1,55 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+
+
+/**
+ * Bump allocator for immutable data which lives until the end of the trace.
+ *
+ * Memory is carved out of large chunks and is never freed individually.
+ */
+class Arena final {
+public:
+  Arena(size_t chunk = 1 << 20);
+
+  /// Allocates uninitialised memory.
+  void *Allocate(size_t size, size_t align);
+
+  /// Copies an array of trivially copyable objects into the arena.
+  template<typename T>
+  const T *Copy(const T *data, size_t n)
+  {
+    if (n == 0) {
+      return nullptr;
+    }
+    T *ptr = static_cast<T *>(Allocate(n * sizeof(T), alignof(T)));
+    memcpy(ptr, data, n * sizeof(T));
+    return ptr;
+  }
+
+  /// Recycles the memory of all allocations, keeping the current chunk.
+  void Reset();
+
+  /// Returns the number of bytes handed out.
+  size_t Size() const { return size_; }
+
+private:
+  /// Default size of a chunk.
+  const size_t chunk_;
+  /// Chunks owned by the arena.
+  std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+  /// Free space in the current chunk.
+  uint8_t *ptr_;
+  /// End of the current chunk.
+  uint8_t *end_;
+  /// Number of bytes handed out.
+  size_t size_;
+};
@@ -0,0 +1,8 @@
+# Offline replay benchmarks: the tracer without its ptrace front-end.
+get_target_property(MKCHECK_SOURCES mkcheck SOURCES)
+list(REMOVE_ITEM MKCHECK_SOURCES mkcheck/mkcheck.cpp)
+add_executable(mkcheck-bench ${MKCHECK_SOURCES} mkcheck/bench.cpp)
+get_target_property(MKCHECK_LIBRARIES mkcheck LINK_LIBRARIES)
+if (MKCHECK_LIBRARIES)
+  target_link_libraries(mkcheck-bench ${MKCHECK_LIBRARIES})
+endif ()
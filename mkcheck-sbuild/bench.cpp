@@ -0,0 +1,322 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "eventlog.h"
+#include "replay.h"
+#include "trace.h"
+
+
+
+// -----------------------------------------------------------------------------
+static uint64_t allocs = 0;
+static size_t liveBytes = 0;
+static size_t peakBytes = 0;
+
+// -----------------------------------------------------------------------------
+void *operator new(size_t size)
+{
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  ++allocs;
+  liveBytes += malloc_usable_size(ptr);
+  peakBytes = std::max(peakBytes, liveBytes);
+  return ptr;
+}
+
+// -----------------------------------------------------------------------------
+void operator delete(void *ptr) noexcept
+{
+  if (ptr) {
+    liveBytes -= malloc_usable_size(ptr);
+    free(ptr);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void operator delete(void *ptr, size_t) noexcept
+{
+  operator delete(ptr);
+}
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr pid_t kPid = 1000;
+static constexpr uint64_t kBase = 0x10000000;
+static constexpr size_t kPaths = 4096;
+static constexpr uint64_t kStride = 4096;
+
+// -----------------------------------------------------------------------------
+static Args MakeArgs(int64_t ret, std::initializer_list<uint64_t> args)
+{
+  Args call{};
+  call.PID = kPid;
+  call.Return = ret;
+  size_t i = 0;
+  for (uint64_t arg : args) {
+    call.Arg[i++] = arg;
+  }
+  return call;
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t PathAddr(size_t idx)
+{
+  return kBase + idx * kStride;
+}
+
+// -----------------------------------------------------------------------------
+static Event MakePathEvent(
+    int64_t sno,
+    int64_t ret,
+    size_t idx,
+    std::initializer_list<uint64_t> args)
+{
+  Event event{ sno, MakeArgs(ret, args), {} };
+  event.Memory.push_back({
+      PathAddr(idx),
+      "src/dir" + std::to_string(idx % 64) + "/file" + std::to_string(idx) + ".c"
+  });
+  return event;
+}
+
+// -----------------------------------------------------------------------------
+static Event OpenFd(int fd)
+{
+  return MakePathEvent(SYS_openat, fd, 0, { (uint64_t)AT_FDCWD, PathAddr(0), O_RDONLY });
+}
+
+
+
+/// Stream of events, split into an untimed prefix and the measured body.
+struct Stream {
+  std::vector<Event> Setup;
+  std::vector<Event> Body;
+};
+
+/// Named stream generator.
+struct Benchmark {
+  const char *Name;
+  std::function<Stream(size_t)> Build;
+};
+
+// -----------------------------------------------------------------------------
+static const Benchmark kBenchmarks[] =
+{
+  { "openat", [] (size_t n) {
+      Stream s;
+      for (size_t i = 0; i < n; ++i) {
+        const size_t idx = i % kPaths;
+        s.Body.push_back(MakePathEvent(
+            SYS_openat, 3 + i % 1024, idx,
+            { (uint64_t)AT_FDCWD, PathAddr(idx), O_RDONLY }
+        ));
+      }
+      return s;
+    }
+  },
+  { "newfstatat", [] (size_t n) {
+      Stream s;
+      for (size_t i = 0; i < n; ++i) {
+        const size_t idx = i % kPaths;
+        s.Body.push_back(MakePathEvent(
+            SYS_newfstatat, 0, idx,
+            { (uint64_t)AT_FDCWD, PathAddr(idx), 0, 0 }
+        ));
+      }
+      return s;
+    }
+  },
+  { "read", [] (size_t n) {
+      Stream s;
+      s.Setup.push_back(OpenFd(3));
+      for (size_t i = 0; i < n; ++i) {
+        s.Body.push_back({ SYS_read, MakeArgs(65536, { 3, 0, 65536 }), {} });
+      }
+      return s;
+    }
+  },
+  { "write", [] (size_t n) {
+      Stream s;
+      s.Setup.push_back(OpenFd(3));
+      for (size_t i = 0; i < n; ++i) {
+        s.Body.push_back({ SYS_write, MakeArgs(4096, { 3, 0, 4096 }), {} });
+      }
+      return s;
+    }
+  },
+  { "fcntl", [] (size_t n) {
+      Stream s;
+      s.Setup.push_back(OpenFd(3));
+      for (size_t i = 0; i < n; ++i) {
+        s.Body.push_back({ SYS_fcntl, MakeArgs(0, { 3, F_SETFD, FD_CLOEXEC }), {} });
+      }
+      return s;
+    }
+  },
+  { "open-close", [] (size_t n) {
+      Stream s;
+      for (size_t i = 0; i < n; i += 2) {
+        const size_t idx = i % kPaths;
+        s.Body.push_back(MakePathEvent(
+            SYS_openat, 3, idx,
+            { (uint64_t)AT_FDCWD, PathAddr(idx), O_RDONLY }
+        ));
+        s.Body.push_back({ SYS_close, MakeArgs(0, { 3 }), {} });
+      }
+      return s;
+    }
+  },
+};
+
+// -----------------------------------------------------------------------------
+static void Run(const std::string &name, const Stream &stream)
+{
+  Trace trace("/dev/null");
+  trace.StartTrace(kPid, "/usr/bin/cc", "/build");
+  Replay(&trace, stream.Setup);
+
+  const uint64_t allocsBefore = allocs;
+  peakBytes = liveBytes;
+  const size_t liveBefore = liveBytes;
+  const auto start = std::chrono::steady_clock::now();
+
+  Replay(&trace, stream.Body);
+
+  const auto end = std::chrono::steady_clock::now();
+  const double secs = std::chrono::duration<double>(end - start).count();
+  const size_t n = stream.Body.size();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf(
+      "%-16s %10zu events %12.0f events/s %8.3f allocs/event %10zu peak heap %8ld KiB max rss\n",
+      name.c_str(),
+      n,
+      n / secs,
+      n ? static_cast<double>(allocs - allocsBefore) / n : 0.0,
+      peakBytes - liveBefore,
+      usage.ru_maxrss
+  );
+}
+
+// -----------------------------------------------------------------------------
+static void RunLog(const std::string &log, const std::string &output)
+{
+  const uint64_t allocsBefore = allocs;
+  peakBytes = liveBytes;
+  const size_t liveBefore = liveBytes;
+  const auto start = std::chrono::steady_clock::now();
+
+  uint64_t n;
+  {
+    Trace trace(output);
+    n = ReplayEventLog(&trace, log);
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  const double secs = std::chrono::duration<double>(end - start).count();
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf(
+      "%-16s %10lu events %12.0f events/s %8.3f allocs/event %10zu peak heap %8ld KiB max rss\n",
+      "replay",
+      n,
+      n / secs,
+      n ? static_cast<double>(allocs - allocsBefore) / n : 0.0,
+      peakBytes - liveBefore,
+      usage.ru_maxrss
+  );
+}
+
+// -----------------------------------------------------------------------------
+static void Usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " [--events=N] [benchmark...]" << std::endl;
+  std::cerr << "       " << argv0 << " --replay=LOG [--output=GRAPH]" << std::endl;
+  std::cerr << std::endl << "Benchmarks:";
+  for (const Benchmark &bench : kBenchmarks) {
+    std::cerr << " " << bench.Name;
+  }
+  std::cerr << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  static struct option kOptions[] = {
+    { "events", required_argument, 0, 'n' },
+    { "replay", required_argument, 0, 'r' },
+    { "output", required_argument, 0, 'o' },
+    { "help",   no_argument,       0, 'h' },
+    { 0,        0,                 0, 0   },
+  };
+
+  size_t events = 1000000;
+  std::string log;
+  std::string output = "/dev/null";
+  int c;
+  while ((c = getopt_long(argc, argv, "n:r:o:h", kOptions, nullptr)) != -1) {
+    switch (c) {
+      case 'n': {
+        events = strtoull(optarg, nullptr, 10);
+        break;
+      }
+      case 'r': {
+        log = optarg;
+        break;
+      }
+      case 'o': {
+        output = optarg;
+        break;
+      }
+      default: {
+        Usage(argv[0]);
+        return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+    }
+  }
+
+  try {
+    if (!log.empty()) {
+      RunLog(log, output);
+      return EXIT_SUCCESS;
+    }
+    for (const Benchmark &bench : kBenchmarks) {
+      bool selected = optind == argc;
+      for (int i = optind; i < argc; ++i) {
+        selected = selected || strcmp(argv[i], bench.Name) == 0;
+      }
+      if (selected) {
+        Run(bench.Name, bench.Build(events));
+      }
+    }
+  } catch (const std::exception &ex) {
+    std::cerr << "[Exception] " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "capture.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+
+#include "memory.h"
+#include "syscall.h"
+
+
+
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO 0x420e
+#endif
+
+/// Mirror of struct ptrace_syscall_info from Linux 5.3.
+struct SyscallInfo {
+  uint8_t Op;
+  uint8_t Pad[3];
+  uint32_t Arch;
+  uint64_t InstructionPointer;
+  uint64_t StackPointer;
+  union {
+    struct {
+      uint64_t Nr;
+      uint64_t Args[6];
+    } Entry;
+    struct {
+      int64_t RVal;
+      uint8_t IsError;
+    } Exit;
+    struct {
+      uint64_t Nr;
+      uint64_t Args[6];
+      uint32_t RetData;
+    } Seccomp;
+  };
+};
+
+enum {
+  kInfoNone = 0,
+  kInfoEntry = 1,
+  kInfoExit = 2,
+  kInfoSeccomp = 3,
+};
+
+/// Syscall recorded at an entry or seccomp stop.
+struct Entry {
+  bool Valid;
+  int64_t Syscall;
+  uint64_t Arg[6];
+};
+
+
+
+// -----------------------------------------------------------------------------
+static std::unordered_map<pid_t, Entry> entries;
+
+// -----------------------------------------------------------------------------
+static bool infoMissing = false;
+
+// -----------------------------------------------------------------------------
+static bool GetInfo(pid_t pid, SyscallInfo &info)
+{
+  if (infoMissing) {
+    return false;
+  }
+
+  if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0) {
+    // Kernels before 5.3 reject the request.
+    if (errno == EIO || errno == EINVAL) {
+      infoMissing = true;
+    }
+    return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+static void GetRegs(pid_t pid, int64_t &sno, Args &args)
+{
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, pid, nullptr, &regs) < 0) {
+    throw std::runtime_error(
+        "Cannot read registers of " + std::to_string(pid) + ": " +
+        strerror(errno)
+    );
+  }
+
+  sno = regs.orig_rax;
+  args.Arg[0] = regs.rdi;
+  args.Arg[1] = regs.rsi;
+  args.Arg[2] = regs.rdx;
+  args.Arg[3] = regs.r10;
+  args.Arg[4] = regs.r8;
+  args.Arg[5] = regs.r9;
+  args.Return = regs.rax;
+}
+
+// -----------------------------------------------------------------------------
+void CaptureEntry(pid_t pid)
+{
+  Entry &entry = entries[pid];
+
+  // The registers are read if the request fails, for any reason.
+  SyscallInfo info;
+  const bool hasInfo = GetInfo(pid, info);
+  if (hasInfo && info.Op == kInfoSeccomp) {
+    entry.Syscall = info.Seccomp.Nr;
+    memcpy(entry.Arg, info.Seccomp.Args, sizeof(entry.Arg));
+  } else if (hasInfo && info.Op == kInfoEntry) {
+    entry.Syscall = info.Entry.Nr;
+    memcpy(entry.Arg, info.Entry.Args, sizeof(entry.Arg));
+  } else {
+    // A tracee killed since it stopped has no registers left to read.
+    Args args;
+    try {
+      GetRegs(pid, entry.Syscall, args);
+    } catch (std::exception &) {
+      entry.Valid = false;
+      return;
+    }
+    memcpy(entry.Arg, args.Arg, sizeof(entry.Arg));
+  }
+  entry.Valid = true;
+
+  if (const unsigned mask = GetStringArgs(entry.Syscall)) {
+    uint64_t addrs[6];
+    size_t n = 0;
+    for (unsigned i = 0; i < 6; ++i) {
+      if (mask & (1u << i)) {
+        addrs[n++] = entry.Arg[i];
+      }
+    }
+    // Strings which cannot be read, such as NULL or unmapped paths, are
+    // read again by the handler, which turns the failure into a diagnostic.
+    try {
+      PrefetchGuestStrings(pid, addrs, n);
+    } catch (std::exception &) {
+      DropGuestStrings(pid);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+int64_t CaptureExit(Trace *trace, pid_t pid)
+{
+  int64_t sno;
+  Args args;
+  args.PID = pid;
+
+  auto it = entries.find(pid);
+  SyscallInfo info;
+  if (it != entries.end() && it->second.Valid &&
+      GetInfo(pid, info) && info.Op == kInfoExit)
+  {
+    sno = it->second.Syscall;
+    memcpy(args.Arg, it->second.Arg, sizeof(args.Arg));
+    args.Return = info.Exit.RVal;
+  } else {
+    GetRegs(pid, sno, args);
+  }
+
+  if (it != entries.end()) {
+    it->second.Valid = false;
+  }
+
+  try {
+    Handle(trace, sno, args);
+  } catch (...) {
+    DropGuestStrings(pid);
+    throw;
+  }
+  DropGuestStrings(pid);
+  return sno;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t CaptureCloneFlags(pid_t pid)
+{
+  // A parent killed since it stopped is never resumed, so it shares nothing.
+  int64_t sno;
+  Args args;
+  try {
+    GetRegs(pid, sno, args);
+  } catch (std::exception &) {
+    return 0;
+  }
+
+  switch (sno) {
+    case SYS_clone: {
+      return args.Arg[0];
+    }
+    case SYS_clone3: {
+      // struct clone_args starts with the 64-bit flags.
+      errno = 0;
+      const long flags = ptrace(PTRACE_PEEKDATA, pid, args.Arg[0], nullptr);
+      if (errno != 0) {
+        throw std::runtime_error(
+            "Cannot read clone_args of " + std::to_string(pid) + ": " +
+            strerror(errno)
+        );
+      }
+      return flags;
+    }
+    default: {
+      return 0;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+
+#include <sys/types.h>
+
+class Trace;
+
+
+
+/**
+ * Returns a mask of the arguments of a syscall which are strings.
+ *
+ * Defined in syscall.cpp, next to the handlers reading them.
+ */
+unsigned GetStringArgs(int64_t sno);
+
+/**
+ * Records the syscall a tracee is about to run.
+ *
+ * Optional: called at a PTRACE_EVENT_SECCOMP stop (or a syscall-entry stop
+ * if the tracer still takes them). The number and arguments come from a
+ * single PTRACE_GET_SYSCALL_INFO request. String arguments are copied here,
+ * before the syscall runs: once it returns, another thread of the tracee
+ * could overwrite them before the exit stop is observed. Strings which
+ * cannot be read are left to the handler, which reports the failure.
+ */
+void CaptureEntry(pid_t pid);
+
+/**
+ * Decodes a syscall at its exit stop and passes it to Handle.
+ *
+ * If the entry was captured, only the return value is fetched. Otherwise,
+ * the number, arguments and return value are all taken from one
+ * PTRACE_GETREGS, since the kernel preserves the argument registers, so
+ * syscall-entry stops can simply be resumed without being inspected.
+ * Returns the number of the syscall.
+ */
+int64_t CaptureExit(Trace *trace, pid_t pid);
+
+/**
+ * Reads the flags of the clone, fork or vfork a tracee stopped in.
+ *
+ * Called at the PTRACE_EVENT_CLONE, FORK or VFORK stop of the parent,
+ * before the parent or the child run again, so the tables the child
+ * shares are known before either of them can change them. Forks and
+ * vforks return 0.
+ */
+uint64_t CaptureCloneFlags(pid_t pid);
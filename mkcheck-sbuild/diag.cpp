@@ -0,0 +1,71 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "diag.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "json.h"
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kMaxDistinct = 1024;
+
+// -----------------------------------------------------------------------------
+static void PrintDiagnostics()
+{
+  GetDiagnostics().Print(std::cerr);
+}
+
+// -----------------------------------------------------------------------------
+bool Diagnostics::Add(int64_t sno, const std::string &what)
+{
+  if (count_++ == 0) {
+    atexit(PrintDiagnostics);
+  }
+
+  // Messages may embed arguments: past a limit, new ones are lumped together.
+  auto key = std::make_pair(sno, what);
+  if (counts_.size() >= kMaxDistinct && !counts_.count(key)) {
+    key.second = "(other)";
+  }
+  return ++counts_[key] == 1;
+}
+
+// -----------------------------------------------------------------------------
+void Diagnostics::Dump(std::ostream &os) const
+{
+  bool first = true;
+  for (const auto &it : counts_) {
+    os << (first ? "" : ",\n");
+    os << "    { \"sno\": " << it.first.first
+       << ", \"what\": \"" << EscapeJson(it.first.second) << "\""
+       << ", \"count\": " << it.second
+       << " }";
+    first = false;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Diagnostics::Print(std::ostream &os) const
+{
+  if (count_ == 0) {
+    return;
+  }
+  os << "[Diagnostics] " << count_ << " syscalls could not be handled:" << std::endl;
+  for (const auto &it : counts_) {
+    const char *name = GetSyscallName(it.first.first);
+    os << "  " << it.second << " x " << (name ? name : "syscall");
+    os << " (" << it.first.first << "): " << it.first.second << std::endl;
+  }
+}
+
+// -----------------------------------------------------------------------------
+Diagnostics &GetDiagnostics()
+{
+  // Never freed: the summary is printed by an exit handler.
+  static Diagnostics *diagnostics = new Diagnostics();
+  return *diagnostics;
+}
@@ -0,0 +1,51 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+
+
+
+/**
+ * Failures of the handlers, counted instead of ending the trace.
+ *
+ * An unknown syscall or an unsupported command loses the effects of one
+ * call; aborting loses the whole build. Each distinct failure is reported
+ * the first time it is seen and a summary is printed when the tracer exits.
+ */
+class Diagnostics final {
+public:
+  /// Records a failure. Returns true if it was not seen before.
+  bool Add(int64_t sno, const std::string &what);
+
+  /// Returns the number of failures.
+  uint64_t GetCount() const { return count_; }
+
+  /// Writes the failures as the elements of a JSON array.
+  void Dump(std::ostream &os) const;
+  /// Prints a summary of the failures.
+  void Print(std::ostream &os) const;
+
+private:
+  /// Occurrences of each failure, by syscall and message.
+  std::map<std::pair<int64_t, std::string>, uint64_t> counts_;
+  /// Number of failures.
+  uint64_t count_ = 0;
+};
+
+/**
+ * Returns the name of a syscall, or nullptr if it is not known.
+ *
+ * Defined in syscall.cpp, from syscalls.def.
+ */
+const char *GetSyscallName(int64_t sno);
+
+/**
+ * Returns the diagnostics of the tracer.
+ */
+Diagnostics &GetDiagnostics();
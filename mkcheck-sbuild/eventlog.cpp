@@ -0,0 +1,485 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "eventlog.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "metrics.h"
+#include "trace.h"
+
+using namespace eventlog;
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kChunk = 64 << 20;
+
+// -----------------------------------------------------------------------------
+static constexpr uint64_t kCheckpointInterval = 60;
+
+// -----------------------------------------------------------------------------
+static constexpr uint64_t kCheckpointPeriod = 1024;
+
+// -----------------------------------------------------------------------------
+static size_t Align(size_t len)
+{
+  return (len + 7) & ~static_cast<size_t>(7);
+}
+
+// -----------------------------------------------------------------------------
+static std::runtime_error Error(const std::string &what, const std::string &path)
+{
+  return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+
+
+// -----------------------------------------------------------------------------
+EventWriter::EventWriter(const std::string &path, uint64_t interval)
+  : fd_(open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+  , data_(nullptr)
+  , capacity_(0)
+  , size_(0)
+  , count_(0)
+  , syscalls_(0)
+  , interval_(interval)
+  , last_(GetTime())
+  , synced_(0)
+{
+  if (fd_ < 0) {
+    throw Error("Cannot open", path);
+  }
+  memcpy(Reserve(sizeof(kMagic)), kMagic, sizeof(kMagic));
+}
+
+// -----------------------------------------------------------------------------
+EventWriter::~EventWriter()
+{
+  Close();
+}
+
+// -----------------------------------------------------------------------------
+uint8_t *EventWriter::Reserve(size_t len)
+{
+  if (size_ + len > capacity_) {
+    const size_t capacity = (size_ + len + kChunk - 1) / kChunk * kChunk;
+    if (ftruncate(fd_, capacity) < 0) {
+      throw std::runtime_error("Cannot grow event log: " + std::string(strerror(errno)));
+    }
+    void *data = data_
+        ? mremap(data_, capacity_, capacity, MREMAP_MAYMOVE)
+        : mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("Cannot map event log: " + std::string(strerror(errno)));
+    }
+    data_ = static_cast<uint8_t *>(data);
+    capacity_ = capacity;
+  }
+
+  uint8_t *ptr = data_ + size_;
+  size_ += len;
+  return ptr;
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddRegion(uint64_t addr, const void *data, size_t len)
+{
+  if (count_ == UINT16_MAX) {
+    throw std::runtime_error("Too many regions in event");
+  }
+
+  const Region region{ addr, len };
+  regions_.append(reinterpret_cast<const char *>(&region), sizeof(region));
+  regions_.append(static_cast<const char *>(data), len);
+  regions_.resize(Align(regions_.size()), '\0');
+  ++count_;
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddSyscall(int64_t sno, const Args &args)
+{
+  const size_t len = sizeof(Header) + sizeof(Syscall) + regions_.size();
+  uint8_t *ptr = Reserve(len);
+
+  Header header{ static_cast<uint32_t>(len), kSyscall, count_, args.PID, 0 };
+  Syscall call;
+  call.Sno = sno;
+  call.Return = args.Return;
+  memcpy(call.Arg, args.Arg, sizeof(call.Arg));
+
+  memcpy(ptr, &header, sizeof(header));
+  memcpy(ptr + sizeof(header), &call, sizeof(call));
+  memcpy(ptr + sizeof(header) + sizeof(call), regions_.data(), regions_.size());
+
+  regions_.clear();
+  count_ = 0;
+
+  // The clock is only read every few syscalls.
+  if (interval_ && ++syscalls_ % kCheckpointPeriod == 0) {
+    if (GetTime() - last_ >= interval_) {
+      AddCheckpoint();
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddSpawn(pid_t parent, pid_t pid, uint64_t flags)
+{
+  const size_t len = sizeof(Header) + sizeof(Spawn);
+  uint8_t *ptr = Reserve(len);
+  Header header{ static_cast<uint32_t>(len), kSpawn, 0, pid, parent };
+  Spawn spawn{ flags };
+  memcpy(ptr, &header, sizeof(header));
+  memcpy(ptr + sizeof(header), &spawn, sizeof(spawn));
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddStart(pid_t pid, const std::string &image, const std::string &cwd)
+{
+  const size_t len = Align(sizeof(Header) + image.size() + cwd.size() + 2);
+  uint8_t *ptr = Reserve(len);
+
+  Header header{ static_cast<uint32_t>(len), kStart, 0, pid, 0 };
+  memcpy(ptr, &header, sizeof(header));
+  memset(ptr + sizeof(header), 0, len - sizeof(header));
+  memcpy(ptr + sizeof(header), image.data(), image.size());
+  memcpy(ptr + sizeof(header) + image.size() + 1, cwd.data(), cwd.size());
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddEnd(pid_t pid)
+{
+  Header header{ sizeof(Header), kEnd, 0, pid, 0 };
+  memcpy(Reserve(sizeof(header)), &header, sizeof(header));
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::AddCheckpoint()
+{
+  // Records before the checkpoint reach the disk before the checkpoint does.
+  const size_t page = sysconf(_SC_PAGESIZE);
+  const size_t from = synced_ / page * page;
+  if (msync(data_ + from, size_ - from, MS_SYNC) < 0) {
+    throw std::runtime_error("Cannot sync event log: " + std::string(strerror(errno)));
+  }
+
+  const size_t len = sizeof(Header) + sizeof(Checkpoint);
+  uint8_t *ptr = Reserve(len);
+  Header header{ static_cast<uint32_t>(len), kCheckpoint, 0, 0, 0 };
+  Checkpoint checkpoint{ syscalls_, static_cast<uint64_t>(time(nullptr)) };
+  memcpy(ptr, &header, sizeof(header));
+  memcpy(ptr + sizeof(header), &checkpoint, sizeof(checkpoint));
+
+  synced_ = size_ - len;
+  last_ = GetTime();
+}
+
+// -----------------------------------------------------------------------------
+void EventWriter::Close()
+{
+  if (fd_ < 0) {
+    return;
+  }
+  if (data_) {
+    // The closing checkpoint tells readers the log is complete.
+    try {
+      AddCheckpoint();
+    } catch (std::exception &ex) {
+      std::cerr << "[Warning] " << ex.what() << std::endl;
+    }
+    munmap(data_, capacity_);
+    data_ = nullptr;
+  }
+  // If this fails, the zero-filled tail is harmless: readers stop at the
+  // first empty header.
+  if (ftruncate(fd_, size_) < 0) {
+    size_ = 0;
+  }
+  close(fd_);
+  fd_ = -1;
+}
+
+// -----------------------------------------------------------------------------
+static void CloseEventWriter()
+{
+  GetEventWriter()->Close();
+}
+
+// -----------------------------------------------------------------------------
+EventWriter *GetEventWriter()
+{
+  static EventWriter *writer = [] () -> EventWriter * {
+    const char *path = getenv("MKCHECK_RECORD");
+    if (!path || !*path) {
+      return nullptr;
+    }
+
+    uint64_t interval = kCheckpointInterval;
+    if (const char *secs = getenv("MKCHECK_CHECKPOINT_INTERVAL")) {
+      interval = strtoull(secs, nullptr, 10);
+    }
+
+    // Never freed: the log is truncated by an exit handler.
+    EventWriter *w = new EventWriter(path, interval * 1000000000ull);
+    atexit(CloseEventWriter);
+    return w;
+  }();
+  return writer;
+}
+
+
+
+/**
+ * Serves reads from the regions of a syscall record.
+ */
+class LogMemory final : public GuestMemory {
+public:
+  /// Selects the regions of a record.
+  void SetRegions(const uint8_t *regions, uint16_t count)
+  {
+    regions_ = regions;
+    count_ = count;
+  }
+
+  void ReadBuffer(pid_t pid, void *buf, uint64_t addr, size_t len) override
+  {
+    memcpy(buf, Find(addr, len), len);
+  }
+
+  std::string ReadString(pid_t pid, uint64_t addr) override
+  {
+    size_t avail;
+    const char *data = reinterpret_cast<const char *>(Find(addr, 0, &avail));
+    return std::string(data, strnlen(data, avail));
+  }
+
+private:
+  /// Finds a range in the regions of the record.
+  const uint8_t *Find(uint64_t addr, size_t len, size_t *avail = nullptr) const
+  {
+    const uint8_t *ptr = regions_;
+    for (uint16_t i = 0; i < count_; ++i) {
+      Region region;
+      memcpy(&region, ptr, sizeof(region));
+      ptr += sizeof(region);
+      if (region.Addr <= addr && addr + len <= region.Addr + region.Length) {
+        if (avail) {
+          *avail = region.Addr + region.Length - addr;
+        }
+        return ptr + (addr - region.Addr);
+      }
+      ptr += Align(region.Length);
+    }
+    throw std::runtime_error("Address not in event log");
+  }
+
+private:
+  /// Regions of the current record.
+  const uint8_t *regions_ = nullptr;
+  /// Number of regions.
+  uint16_t count_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+static bool IsComplete(const uint8_t *data, const Header &header)
+{
+  // A record cut short by a crash has a length its body does not match.
+  const uint8_t *body = data + sizeof(header);
+  const size_t len = header.Length - sizeof(header);
+  switch (header.Kind) {
+    case kSyscall: {
+      if (len < sizeof(Syscall)) {
+        return false;
+      }
+      size_t off = sizeof(Syscall);
+      for (uint16_t i = 0; i < header.Regions; ++i) {
+        Region region;
+        if (off + sizeof(region) > len) {
+          return false;
+        }
+        memcpy(&region, body + off, sizeof(region));
+        off += sizeof(region);
+        if (region.Length > len - off || Align(region.Length) > len - off) {
+          return false;
+        }
+        off += Align(region.Length);
+      }
+      return off == len;
+    }
+    case kSpawn: {
+      return len == 0 || len == sizeof(Spawn);
+    }
+    case kStart: {
+      // The image and the directory are both terminated.
+      const char *image = reinterpret_cast<const char *>(body);
+      const size_t n = strnlen(image, len);
+      return n + 1 < len && strnlen(image + n + 1, len - n - 1) < len - n - 1;
+    }
+    case kEnd: {
+      return len == 0;
+    }
+    case kCheckpoint: {
+      return len == sizeof(Checkpoint);
+    }
+    default: {
+      return true;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+static size_t FindReplayEnd(const uint8_t *data, size_t size, const std::string &path)
+{
+  // The log must describe the processes its syscalls belong to.
+  bool lifecycle = false;
+  bool complete = false;
+  uint64_t unsynced = 0;
+  size_t off = sizeof(kMagic);
+  while (off + sizeof(Header) <= size) {
+    Header header;
+    memcpy(&header, data + off, sizeof(header));
+    if (header.Length < sizeof(Header) || header.Length % 8 != 0 ||
+        header.Length > size - off || !IsComplete(data + off, header))
+    {
+      break;
+    }
+    switch (header.Kind) {
+      case kSyscall: {
+        ++unsynced;
+        break;
+      }
+      case kSpawn:
+      case kStart:
+      case kEnd: {
+        lifecycle = true;
+        break;
+      }
+      case kCheckpoint: {
+        unsynced = 0;
+        break;
+      }
+    }
+    complete = header.Kind == kCheckpoint;
+    off += header.Length;
+  }
+
+  if (!lifecycle) {
+    throw std::runtime_error("Event log without processes: " + path);
+  }
+
+  // Records after the last checkpoint were not synced: pages may have
+  // reached the disk out of order, so the replay stops at the first record
+  // which does not hold together. What precedes it is consistent.
+  if (!complete) {
+    std::cerr
+        << "[Warning] Event log " << path << " was interrupted: "
+        << "replaying up to the last complete record, "
+        << unsynced << " syscalls after the last checkpoint"
+        << std::endl;
+  }
+  return off;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t ReplayEventLog(Trace *trace, const std::string &path)
+{
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw Error("Cannot open", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw Error("Cannot stat", path);
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(kMagic)) {
+    close(fd);
+    throw std::runtime_error("Not an event log: " + path);
+  }
+  void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw Error("Cannot map", path);
+  }
+  const uint8_t *data = static_cast<const uint8_t *>(map);
+
+  LogMemory memory;
+  uint64_t count = 0;
+  try {
+    if (memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      throw std::runtime_error("Not an event log: " + path);
+    }
+    const size_t end = FindReplayEnd(data, size, path);
+
+    SetGuestMemory(&memory);
+    for (size_t off = sizeof(kMagic); off < end; ) {
+      Header header;
+      memcpy(&header, data + off, sizeof(header));
+
+      const uint8_t *body = data + off + sizeof(header);
+      switch (header.Kind) {
+        case kSyscall: {
+          Syscall call;
+          memcpy(&call, body, sizeof(call));
+
+          Args args;
+          args.PID = header.PID;
+          args.Return = call.Return;
+          memcpy(args.Arg, call.Arg, sizeof(args.Arg));
+
+          memory.SetRegions(body + sizeof(call), header.Regions);
+          Handle(trace, call.Sno, args);
+          ++count;
+          break;
+        }
+        case kSpawn: {
+          // Logs written before the flags were recorded hold forks only.
+          Spawn spawn{ 0 };
+          if (header.Length >= sizeof(header) + sizeof(spawn)) {
+            memcpy(&spawn, body, sizeof(spawn));
+          }
+          trace->SpawnTrace(header.Parent, header.PID, spawn.Flags);
+          break;
+        }
+        case kStart: {
+          const char *image = reinterpret_cast<const char *>(body);
+          const size_t len = header.Length - sizeof(header);
+          const size_t n = strnlen(image, len);
+          const std::string cwd = n + 1 < len ? std::string(image + n + 1) : "";
+          trace->StartTrace(header.PID, std::string(image, n), cwd);
+          break;
+        }
+        case kEnd: {
+          trace->EndTrace(header.PID);
+          break;
+        }
+        default: {
+          // Checkpoints, and records from newer writers, are skipped.
+          break;
+        }
+      }
+      off += header.Length;
+    }
+  } catch (...) {
+    SetGuestMemory(nullptr);
+    munmap(map, size);
+    throw;
+  }
+
+  SetGuestMemory(nullptr);
+  munmap(map, size);
+  return count;
+}
@@ -0,0 +1,167 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+#include "syscall.h"
+
+class Trace;
+
+
+
+/**
+ * Binary log of the events seen by the tracer.
+ *
+ * The log starts with an 8-byte magic, followed by records aligned to 8
+ * bytes. Each record starts with a header holding its length, so readers
+ * can skip unknown kinds. Syscall records carry the raw arguments, the
+ * return value and every region of tracee memory read by the handler,
+ * which is enough to run the handlers again without the tracees. Start
+ * records carry the image and, for the root, the directory it started in,
+ * so the replay resolves paths as the trace did wherever it runs.
+ *
+ * The log is also the state of the tracer: folding the records through the
+ * handlers rebuilds it. Checkpoint records are written periodically, once
+ * everything before them was synced to disk: they mark the prefix which
+ * survives a crash, so a build interrupted by one can be analysed again
+ * from the log instead of being rebuilt. A last checkpoint is written when
+ * the log is closed.
+ */
+namespace eventlog {
+
+/// Magic identifying the format and its version.
+constexpr char kMagic[8] = { 'M', 'K', 'E', 'V', 'L', 'O', 'G', '1' };
+
+/// Kinds of records.
+enum Kind : uint16_t {
+  kSyscall = 1,
+  kSpawn   = 2,
+  kStart   = 3,
+  kEnd     = 4,
+  kCheckpoint = 5,
+};
+
+/// Header of all records.
+struct Header {
+  /// Length of the record, including the header and padding.
+  uint32_t Length;
+  /// Kind of the record.
+  uint16_t Kind;
+  /// Number of memory regions, for syscalls.
+  uint16_t Regions;
+  /// Process the event belongs to.
+  int32_t PID;
+  /// Parent, for spawn records.
+  int32_t Parent;
+};
+
+/// Fixed part of syscall records, following the header.
+struct Syscall {
+  int64_t Sno;
+  int64_t Return;
+  uint64_t Arg[6];
+};
+
+/// Spawn records, following the header.
+struct Spawn {
+  /// Clone flags of the child, 0 for fork and vfork.
+  uint64_t Flags;
+};
+
+/// Checkpoint records, following the header.
+struct Checkpoint {
+  /// Number of syscalls written before the checkpoint.
+  uint64_t Syscalls;
+  /// Wall-clock time of the checkpoint, in seconds.
+  uint64_t Time;
+};
+
+/// Header of a region, followed by its data and padding.
+struct Region {
+  uint64_t Addr;
+  uint64_t Length;
+};
+
+}
+
+/**
+ * Appends records to a memory-mapped log.
+ *
+ * Regions read by a handler are staged until the syscall is committed.
+ */
+class EventWriter final {
+public:
+  EventWriter(const std::string &path, uint64_t interval);
+  ~EventWriter();
+
+  /// Stages a region of tracee memory read by the current handler.
+  void AddRegion(uint64_t addr, const void *data, size_t len);
+  /// Writes a syscall along with the staged regions.
+  void AddSyscall(int64_t sno, const Args &args);
+
+  /// Records the creation of a process by fork, vfork or clone.
+  void AddSpawn(pid_t parent, pid_t pid, uint64_t flags);
+  /// Records the start of a process from an image, in a directory for
+  /// the root.
+  void AddStart(pid_t pid, const std::string &image, const std::string &cwd);
+  /// Records the termination of a process.
+  void AddEnd(pid_t pid);
+
+  /// Syncs the log to disk and marks the point as consistent.
+  void AddCheckpoint();
+
+  /// Writes a last checkpoint, truncates the file and unmaps it.
+  void Close();
+
+private:
+  /// Reserves space for a record, growing the mapping if needed.
+  uint8_t *Reserve(size_t len);
+
+private:
+  /// File descriptor of the log.
+  int fd_;
+  /// Mapping of the log.
+  uint8_t *data_;
+  /// Size of the mapping.
+  size_t capacity_;
+  /// Number of bytes written.
+  size_t size_;
+  /// Regions staged for the next syscall.
+  std::string regions_;
+  /// Number of staged regions.
+  uint16_t count_;
+  /// Number of syscalls written.
+  uint64_t syscalls_;
+  /// Nanoseconds between checkpoints, 0 to disable them.
+  const uint64_t interval_;
+  /// Time of the last checkpoint.
+  uint64_t last_;
+  /// Number of bytes synced to disk.
+  size_t synced_;
+};
+
+/**
+ * Returns the log of the tracer, or nullptr if MKCHECK_RECORD is not set.
+ *
+ * Checkpoints are written every MKCHECK_CHECKPOINT_INTERVAL seconds,
+ * 60 by default; 0 disables them.
+ */
+EventWriter *GetEventWriter();
+
+/**
+ * Runs the handlers over a log, in order, without any tracees.
+ *
+ * Regions are served straight from the mapping of the log. Records are
+ * replayed up to the first one whose length does not match its contents.
+ * A log which does not end with a checkpoint was interrupted: it is
+ * replayed up to its last complete record, with a warning. Logs without
+ * process records are rejected, since their syscalls cannot be attributed.
+ * Returns the number of syscalls replayed.
+ */
+uint64_t ReplayEventLog(Trace *trace, const std::string &path);
@@ -0,0 +1,13 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "fdevents.h"
+
+
+
+// -----------------------------------------------------------------------------
+FdEvents &GetFdEvents()
+{
+  static FdEvents events;
+  return events;
+}
@@ -0,0 +1,117 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+
+/**
+ * Events already reported for the open file descriptors of each process.
+ *
+ * Processes are keyed by their UID, which is never reused. Reporting is
+ * idempotent, so once an fd was recorded as an input or an output, later
+ * I/O on it can be skipped until the fd or the file it names changes.
+ *
+ * Events are tagged with the generation of the fd in the fd tables (see
+ * fdtable.h), which changes whenever the fd is opened or closed. Processes
+ * sharing a table through CLONE_FILES thus see an fd replaced by any of
+ * them as a new one.
+ */
+class FdEvents final {
+public:
+  /// Kinds of events.
+  enum Kind : uint8_t {
+    kInput  = 1 << 0,
+    kOutput = 1 << 1,
+  };
+
+public:
+  /// Returns true if the event was not reported yet for a generation of
+  /// the fd, marking it as such.
+  bool Mark(uint64_t uid, int fd, uint32_t gen, Kind kind)
+  {
+    if (fd < 0) {
+      return true;
+    }
+    std::vector<Slot> &slots = Get(uid);
+    if (static_cast<size_t>(fd) >= slots.size()) {
+      slots.resize(fd + 1);
+    }
+    Slot &slot = slots[fd];
+    if (slot.Gen != gen) {
+      slot.Gen = gen;
+      slot.Kinds = 0;
+    }
+    if (slot.Kinds & kind) {
+      return false;
+    }
+    slot.Kinds |= kind;
+    return true;
+  }
+
+  /// Drops the flags of a process which exited.
+  void Drop(uint64_t uid)
+  {
+    procs_.erase(uid);
+    if (uid == lastUID_) {
+      last_ = nullptr;
+    }
+  }
+
+  /// Forgets all events, after files were renamed.
+  void Clear()
+  {
+    ++epoch_;
+  }
+
+private:
+  /// Events reported for an fd.
+  struct Slot {
+    /// Generation of the fd the events were reported for.
+    uint32_t Gen = 0;
+    /// Kinds of events reported.
+    uint8_t Kinds = 0;
+  };
+
+  /// Flags of a process.
+  struct ProcFlags {
+    /// Value of epoch_ when the flags were last valid.
+    uint32_t Epoch = 0;
+    /// Events, indexed by fd.
+    std::vector<Slot> Flags;
+  };
+
+  /// Returns the flags of a process.
+  std::vector<Slot> &Get(uint64_t uid)
+  {
+    if (uid != lastUID_ || !last_) {
+      last_ = &procs_[uid];
+      lastUID_ = uid;
+    }
+    if (last_->Epoch != epoch_) {
+      std::fill(last_->Flags.begin(), last_->Flags.end(), Slot());
+      last_->Epoch = epoch_;
+    }
+    return last_->Flags;
+  }
+
+private:
+  /// Flags of each process.
+  std::unordered_map<uint64_t, ProcFlags> procs_;
+  /// Incremented to lazily clear the flags of all processes.
+  uint32_t epoch_ = 0;
+  /// UID of the most recently used process.
+  uint64_t lastUID_ = 0;
+  /// Flags of the most recently used process.
+  ProcFlags *last_ = nullptr;
+};
+
+/**
+ * Returns the table shared by all handlers.
+ */
+FdEvents &GetFdEvents();
@@ -0,0 +1,181 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "fdtable.h"
+
+
+
+// -----------------------------------------------------------------------------
+FdTables::Files &FdTables::Get(uint64_t uid)
+{
+  std::shared_ptr<Files> &files = procs_[uid];
+  if (!files) {
+    files = std::make_shared<Files>();
+    files->Data = std::make_shared<Entries>();
+    files->ID = ++nextID_;
+  }
+  return *files;
+}
+
+// -----------------------------------------------------------------------------
+FdTables::Entry &FdTables::Write(Files &files, int fd)
+{
+  if (files.Data.use_count() > 1) {
+    files.Data = std::make_shared<Entries>(*files.Data);
+  }
+  Entries &entries = *files.Data;
+  if (static_cast<size_t>(fd) >= entries.size()) {
+    entries.resize(fd + 1);
+  }
+  return entries[fd];
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::Spawn(uint64_t parent, uint64_t uid, bool share)
+{
+  if (share) {
+    Get(parent);
+    procs_[uid] = procs_[parent];
+    return;
+  }
+
+  auto child = std::make_shared<Files>();
+  child->ID = ++nextID_;
+  auto it = procs_.find(parent);
+  if (it != procs_.end()) {
+    child->Data = it->second->Data;
+    child->Execs = it->second->Execs;
+  } else {
+    child->Data = std::make_shared<Entries>();
+  }
+  procs_[uid] = std::move(child);
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::Exec(uint64_t uid)
+{
+  auto it = procs_.find(uid);
+  if (it == procs_.end()) {
+    return;
+  }
+
+  // The kernel unshares the table of the exec'ing thread group.
+  if (it->second.use_count() > 1) {
+    it->second = std::make_shared<Files>(*it->second);
+    it->second->ID = ++nextID_;
+  }
+  ++it->second->Execs;
+}
+
+// -----------------------------------------------------------------------------
+bool FdTables::Drop(uint64_t uid)
+{
+  auto it = procs_.find(uid);
+  if (it == procs_.end()) {
+    return false;
+  }
+  const bool last = it->second.use_count() == 1;
+  procs_.erase(it);
+  return last;
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::Map(uint64_t uid, int fd, PathID path)
+{
+  if (fd < 0) {
+    return;
+  }
+  Files &files = Get(uid);
+  Entry &entry = Write(files, fd);
+  entry.Path = path;
+  entry.Execs = files.Execs;
+  entry.Gen = ++gen_;
+  entry.Open = true;
+  entry.CloseExec = false;
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::SetCloseExec(uint64_t uid, int fd, bool closeExec)
+{
+  auto it = procs_.find(uid);
+  if (fd < 0 || it == procs_.end()) {
+    return;
+  }
+  Files &files = *it->second;
+  const Entries &entries = *files.Data;
+  if (static_cast<size_t>(fd) >= entries.size()) {
+    return;
+  }
+  const Entry &old = entries[fd];
+  if (!IsOpen(files, old) || old.CloseExec == closeExec) {
+    return;
+  }
+
+  Entry &entry = Write(files, fd);
+  entry.CloseExec = closeExec;
+  entry.Execs = files.Execs;
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::Dup(uint64_t uid, int oldfd, int newfd)
+{
+  if (newfd < 0 || oldfd == newfd) {
+    return;
+  }
+
+  PathID path;
+  if (Find(uid, oldfd, &path)) {
+    Map(uid, newfd, path);
+  } else {
+    Close(uid, newfd);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void FdTables::Close(uint64_t uid, int fd)
+{
+  auto it = procs_.find(uid);
+  if (fd < 0 || it == procs_.end()) {
+    return;
+  }
+  Files &files = *it->second;
+  if (static_cast<size_t>(fd) >= files.Data->size()) {
+    return;
+  }
+  if (!(*files.Data)[fd].Open) {
+    return;
+  }
+  Entry &entry = Write(files, fd);
+  entry = Entry();
+  entry.Gen = ++gen_;
+}
+
+// -----------------------------------------------------------------------------
+bool FdTables::Find(uint64_t uid, int fd, PathID *path, uint32_t *gen) const
+{
+  auto it = procs_.find(uid);
+  if (fd < 0 || it == procs_.end()) {
+    return false;
+  }
+  const Files &files = *it->second;
+  const Entries &entries = *files.Data;
+  if (static_cast<size_t>(fd) >= entries.size()) {
+    return false;
+  }
+  const Entry &entry = entries[fd];
+  if (!IsOpen(files, entry)) {
+    return false;
+  }
+  *path = entry.Path;
+  if (gen) {
+    *gen = entry.Gen;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+FdTables &GetFdTables()
+{
+  static FdTables tables;
+  return tables;
+}
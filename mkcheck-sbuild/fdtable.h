@@ -0,0 +1,107 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "path.h"
+
+
+
+/**
+ * Files named by the descriptors of each process, shared copy-on-write.
+ *
+ * Processes are keyed by their UID. A fork shares the table of the parent
+ * until either of them changes it, so spawning is O(1) regardless of the
+ * number of open descriptors. Clones with CLONE_FILES share the table
+ * outright. Descriptors opened with close-on-exec are tagged with the
+ * number of execs of their table and become invalid once it changes, so
+ * the sweep at exec is O(1) as well.
+ *
+ * These are the only fd tables of the tracer. Lookups miss for fds which
+ * do not name files, such as pipes, and for the ones inherited by the root
+ * other than the standard streams.
+ */
+class FdTables final {
+public:
+  /// Registers a child which shares the table of its parent if it was
+  /// cloned with CLONE_FILES, or copies it otherwise.
+  void Spawn(uint64_t parent, uint64_t uid, bool share);
+  /// Unshares the table of a process and closes its close-on-exec fds.
+  void Exec(uint64_t uid);
+  /// Drops the table of a process which exited. Returns true if no other
+  /// process shares the table.
+  bool Drop(uint64_t uid);
+
+  /// Returns the ID of the table of a process, never reused by another.
+  uint64_t GetID(uint64_t uid) { return Get(uid).ID; }
+
+  /// Maps an fd to a file.
+  void Map(uint64_t uid, int fd, PathID path);
+  /// Sets the close-on-exec flag of an fd.
+  void SetCloseExec(uint64_t uid, int fd, bool closeExec);
+  /// Duplicates an fd, clearing the close-on-exec flag.
+  void Dup(uint64_t uid, int oldfd, int newfd);
+  /// Closes an fd, or forgets it if it no longer names a known file.
+  void Close(uint64_t uid, int fd);
+
+  /// Finds the file named by an fd, along with the generation of the fd.
+  bool Find(uint64_t uid, int fd, PathID *path, uint32_t *gen = nullptr) const;
+
+private:
+  /// Descriptor entry.
+  struct Entry {
+    /// File named by the fd.
+    PathID Path = 0;
+    /// Value of Files::Execs when the close-on-exec flag was set.
+    uint32_t Execs = 0;
+    /// Generation of the fd, changed by every open or close in any table.
+    uint32_t Gen = 0;
+    /// Set if the entry is valid.
+    bool Open = false;
+    /// Set if the fd is closed on exec.
+    bool CloseExec = false;
+  };
+
+  /// Table shared between processes forked from each other.
+  using Entries = std::vector<Entry>;
+
+  /// Table shared between processes cloned with CLONE_FILES.
+  struct Files {
+    /// Entries, copied before the first write if shared.
+    std::shared_ptr<Entries> Data;
+    /// Number of execs performed through this table.
+    uint32_t Execs = 0;
+    /// Unique ID of the table.
+    uint64_t ID = 0;
+  };
+
+  /// Returns the table of a process, creating it if needed.
+  Files &Get(uint64_t uid);
+  /// Returns a writable entry, copying the entries if they are shared.
+  static Entry &Write(Files &files, int fd);
+  /// Checks if an entry is valid in a table.
+  static bool IsOpen(const Files &files, const Entry &entry)
+  {
+    return entry.Open && !(entry.CloseExec && entry.Execs != files.Execs);
+  }
+
+private:
+  /// Tables of the processes.
+  std::unordered_map<uint64_t, std::shared_ptr<Files>> procs_;
+  /// Last generation assigned to an fd.
+  uint32_t gen_ = 0;
+  /// Last ID assigned to a table.
+  uint64_t nextID_ = 0;
+};
+
+/**
+ * Returns the tables shared by all handlers.
+ */
+FdTables &GetFdTables();
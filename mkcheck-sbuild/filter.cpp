@@ -0,0 +1,463 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "filter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+
+
+// -----------------------------------------------------------------------------
+static std::string Trim(const std::string &str)
+{
+  const size_t begin = str.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return str.substr(begin, str.find_last_not_of(" \t\r") - begin + 1);
+}
+
+// -----------------------------------------------------------------------------
+static std::string Unquote(const std::string &str)
+{
+  if (str.size() >= 2 && (str[0] == '\'' || str[0] == '"') && str.back() == str[0]) {
+    return str.substr(1, str.size() - 2);
+  }
+  return str;
+}
+
+// -----------------------------------------------------------------------------
+static std::vector<std::string> ReadRules(const std::string &path, const std::string &key)
+{
+  std::ifstream is(path);
+  if (!is) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+
+  // Only the block lists of the rule files are understood.
+  std::vector<std::string> rules;
+  std::string line;
+  bool inKey = false;
+  while (std::getline(is, line)) {
+    const std::string item = Trim(line);
+    if (item.empty() || item[0] == '#') {
+      continue;
+    }
+    if (item[0] == '-') {
+      if (inKey) {
+        rules.push_back(Unquote(Trim(item.substr(1))));
+      }
+      continue;
+    }
+    inKey = item == key + ":";
+  }
+  return rules;
+}
+
+
+
+/**
+ * Recursive descent parser of a pattern, adding its nodes to the NFA.
+ */
+class PathMatcher::Parser final {
+public:
+  Parser(PathMatcher &m, const std::string &pattern)
+    : m_(m)
+    , pattern_(pattern)
+    , pos_(0)
+  {
+  }
+
+  /// Parses the whole pattern.
+  Fragment Parse()
+  {
+    Fragment frag = Alternation();
+    if (pos_ != pattern_.size()) {
+      Fail("unbalanced parenthesis");
+    }
+    return frag;
+  }
+
+private:
+  /// Parses branches separated by `|`.
+  Fragment Alternation()
+  {
+    Fragment frag = Concatenation();
+    while (Accept('|')) {
+      Fragment alt = Concatenation();
+      const int split = m_.AddNode(Node::kSplit);
+      m_.nodes_[split].Out = frag.Start;
+      m_.nodes_[split].Alt = alt.Start;
+      frag.Start = split;
+      frag.Exits.insert(frag.Exits.end(), alt.Exits.begin(), alt.Exits.end());
+    }
+    return frag;
+  }
+
+  /// Parses a sequence of repeated atoms.
+  Fragment Concatenation()
+  {
+    if (pos_ == pattern_.size() || Peek() == '|' || Peek() == ')') {
+      // An empty branch is a split with both exits dangling.
+      const int empty = m_.AddNode(Node::kSplit);
+      return Fragment{ empty, { 2 * empty, 2 * empty + 1 } };
+    }
+
+    Fragment frag = Repetition();
+    while (pos_ < pattern_.size() && Peek() != '|' && Peek() != ')') {
+      Fragment next = Repetition();
+      m_.Patch(frag.Exits, next.Start);
+      frag.Exits = std::move(next.Exits);
+    }
+    return frag;
+  }
+
+  /// Parses an atom followed by quantifiers.
+  Fragment Repetition()
+  {
+    Fragment frag = Atom();
+    while (pos_ < pattern_.size()) {
+      const char op = Peek();
+      if (op != '*' && op != '+' && op != '?') {
+        break;
+      }
+      ++pos_;
+
+      const int split = m_.AddNode(Node::kSplit);
+      m_.nodes_[split].Out = frag.Start;
+      switch (op) {
+        case '*': {
+          m_.Patch(frag.Exits, split);
+          frag = Fragment{ split, { 2 * split + 1 } };
+          break;
+        }
+        case '+': {
+          m_.Patch(frag.Exits, split);
+          frag.Exits = { 2 * split + 1 };
+          break;
+        }
+        case '?': {
+          frag.Start = split;
+          frag.Exits.push_back(2 * split + 1);
+          break;
+        }
+      }
+    }
+    return frag;
+  }
+
+  /// Parses a group, a class, a wildcard or a character.
+  Fragment Atom()
+  {
+    std::bitset<256> set;
+    const char c = pattern_[pos_++];
+    switch (c) {
+      case '(': {
+        if (Accept('?')) {
+          if (!Accept(':')) {
+            Fail("unsupported group");
+          }
+        }
+        Fragment frag = Alternation();
+        if (!Accept(')')) {
+          Fail("unbalanced parenthesis");
+        }
+        return frag;
+      }
+      case '[': {
+        set = Class();
+        break;
+      }
+      case '.': {
+        set.set();
+        set.reset('\n');
+        break;
+      }
+      case '\\': {
+        set = Escape();
+        break;
+      }
+      case '*': case '+': case '?': {
+        Fail("nothing to repeat");
+      }
+      case '^': case '$': case '{': {
+        Fail("unsupported operator");
+      }
+      default: {
+        set.set(static_cast<uint8_t>(c));
+        break;
+      }
+    }
+    const int node = m_.AddNode(Node::kSet, set);
+    return Fragment{ node, { 2 * node } };
+  }
+
+  /// Parses the contents of a class, after `[`.
+  std::bitset<256> Class()
+  {
+    std::bitset<256> set;
+    const bool negate = Accept('^');
+    bool first = true;
+    while (first || Peek() != ']') {
+      first = false;
+      if (pos_ >= pattern_.size()) {
+        Fail("unterminated class");
+      }
+      const char c = pattern_[pos_++];
+      if (c == '\\') {
+        set |= Escape();
+        continue;
+      }
+      if (pos_ + 1 < pattern_.size() && Peek() == '-' && pattern_[pos_ + 1] != ']') {
+        const char hi = pattern_[pos_ + 1];
+        pos_ += 2;
+        for (int i = static_cast<uint8_t>(c); i <= static_cast<uint8_t>(hi); ++i) {
+          set.set(i);
+        }
+        continue;
+      }
+      set.set(static_cast<uint8_t>(c));
+    }
+    ++pos_;
+    return negate ? ~set : set;
+  }
+
+  /// Parses an escape, after the backslash.
+  std::bitset<256> Escape()
+  {
+    if (pos_ >= pattern_.size()) {
+      Fail("trailing backslash");
+    }
+
+    std::bitset<256> set;
+    const char c = pattern_[pos_++];
+    switch (c) {
+      case 'd': case 'D': {
+        for (int i = '0'; i <= '9'; ++i) {
+          set.set(i);
+        }
+        break;
+      }
+      case 'w': case 'W': {
+        for (int i = 0; i < 256; ++i) {
+          set[i] = isalnum(i) || i == '_';
+        }
+        break;
+      }
+      case 's': case 'S': {
+        for (const char *p = " \t\n\r\f\v"; *p; ++p) {
+          set.set(static_cast<uint8_t>(*p));
+        }
+        break;
+      }
+      default: {
+        set.set(static_cast<uint8_t>(c));
+        return set;
+      }
+    }
+    return isupper(c) ? ~set : set;
+  }
+
+  /// Returns the next character.
+  char Peek() const
+  {
+    return pos_ < pattern_.size() ? pattern_[pos_] : '\0';
+  }
+
+  /// Consumes a character if it is next.
+  bool Accept(char c)
+  {
+    if (pos_ < pattern_.size() && pattern_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  /// Reports an invalid pattern.
+  [[noreturn]] void Fail(const char *what) const
+  {
+    throw std::runtime_error("Invalid filter rule " + pattern_ + ": " + what);
+  }
+
+private:
+  /// Matcher being built.
+  PathMatcher &m_;
+  /// Pattern being parsed.
+  const std::string &pattern_;
+  /// Position in the pattern.
+  size_t pos_;
+};
+
+
+
+// -----------------------------------------------------------------------------
+PathMatcher::PathMatcher(const std::vector<std::string> &patterns)
+{
+  std::vector<int> starts;
+  for (const std::string &pattern : patterns) {
+    Fragment frag = Parser(*this, pattern).Parse();
+    Patch(frag.Exits, AddNode(Node::kAccept));
+    starts.push_back(frag.Start);
+  }
+
+  std::vector<int> set;
+  std::vector<bool> seen(nodes_.size());
+  for (int node : starts) {
+    Closure(node, set, seen);
+  }
+  start_ = GetState(std::move(set));
+}
+
+// -----------------------------------------------------------------------------
+bool PathMatcher::Match(const char *str, size_t len)
+{
+  int state = start_;
+  for (size_t i = 0; i < len; ++i) {
+    const uint8_t c = str[i];
+    const int next = states_[state].Next[c];
+    state = next < 0 ? Step(state, c) : next;
+    if (sets_[state].empty()) {
+      return false;
+    }
+  }
+  return states_[state].Accept;
+}
+
+// -----------------------------------------------------------------------------
+int PathMatcher::AddNode(Node::Kind kind, const std::bitset<256> &set)
+{
+  nodes_.push_back(Node{ kind, set, -1, -1 });
+  return nodes_.size() - 1;
+}
+
+// -----------------------------------------------------------------------------
+void PathMatcher::Patch(const std::vector<int> &exits, int node)
+{
+  for (int exit : exits) {
+    Node &from = nodes_[exit / 2];
+    (exit % 2 ? from.Alt : from.Out) = node;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void PathMatcher::Closure(int node, std::vector<int> &set, std::vector<bool> &seen) const
+{
+  std::vector<int> stack{ node };
+  while (!stack.empty()) {
+    const int n = stack.back();
+    stack.pop_back();
+    if (seen[n]) {
+      continue;
+    }
+    seen[n] = true;
+    if (nodes_[n].Type == Node::kSplit) {
+      stack.push_back(nodes_[n].Alt);
+      stack.push_back(nodes_[n].Out);
+    } else {
+      set.push_back(n);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+int PathMatcher::GetState(std::vector<int> &&set)
+{
+  std::sort(set.begin(), set.end());
+  auto it = ids_.find(set);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  State state;
+  state.Accept = std::any_of(set.begin(), set.end(), [this] (int n) {
+    return nodes_[n].Type == Node::kAccept;
+  });
+  state.Next.fill(-1);
+
+  const int id = states_.size();
+  states_.push_back(state);
+  ids_.emplace(set, id);
+  sets_.push_back(std::move(set));
+  return id;
+}
+
+// -----------------------------------------------------------------------------
+int PathMatcher::Step(int state, uint8_t c)
+{
+  std::vector<int> set;
+  std::vector<bool> seen(nodes_.size());
+  for (int n : sets_[state]) {
+    const Node &node = nodes_[n];
+    if (node.Type == Node::kSet && node.Set[c]) {
+      Closure(node.Out, set, seen);
+    }
+  }
+  const int next = GetState(std::move(set));
+  states_[state].Next[c] = next;
+  return next;
+}
+
+
+
+// -----------------------------------------------------------------------------
+PathFilter::PathFilter(const std::vector<std::string> &patterns)
+  : matcher_(patterns)
+  , dropped_(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+PathFilter::Verdict &PathFilter::Get(PathID path)
+{
+  if (path >= verdicts_.size()) {
+    verdicts_.resize(std::max<size_t>(path + 1, verdicts_.size() * 2), kUnknown);
+  }
+  return verdicts_[path];
+}
+
+// -----------------------------------------------------------------------------
+bool PathFilter::IsExcluded(PathID path)
+{
+  Verdict &verdict = Get(path);
+  if (verdict == kUnknown) {
+    const std::string &name = GetPathTable().Get(path);
+    verdict = matcher_.Match(name.data(), name.size()) ? kExcluded : kKept;
+  }
+  return verdict == kExcluded;
+}
+
+// -----------------------------------------------------------------------------
+bool PathFilter::Excludes(PathID path)
+{
+  if (IsExcluded(path)) {
+    ++dropped_;
+    return true;
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+void PathFilter::AddProduced(PathID path)
+{
+  // Generated files are kept even if they match the rules.
+  Get(path) = kProduced;
+}
+
+// -----------------------------------------------------------------------------
+PathFilter *GetPathFilter()
+{
+  static PathFilter *filter = [] () -> PathFilter * {
+    const char *path = getenv("MKCHECK_FILTER");
+    if (!path || !*path) {
+      return nullptr;
+    }
+    // Never freed: the verdicts are used until the tracer exits.
+    return new PathFilter(ReadRules(path, "filter_in"));
+  }();
+  return filter;
+}
@@ -0,0 +1,144 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "path.h"
+
+
+
+/**
+ * Set of regular expressions compiled into a single DFA.
+ *
+ * Patterns are matched against the whole path, like the filter rules of
+ * fuzz_test, and support literals, escapes, `.`, classes, groups,
+ * alternation and the `*`, `+` and `?` quantifiers. All patterns share one
+ * NFA, whose DFA is built lazily: a state is only created when some path
+ * reaches it, so common prefixes such as `/usr/` form a trie walked once
+ * per character.
+ */
+class PathMatcher final {
+public:
+  /// Compiles the patterns, throwing on unsupported syntax.
+  PathMatcher(const std::vector<std::string> &patterns);
+
+  /// Checks if any of the patterns matches the whole string.
+  bool Match(const char *str, size_t len);
+
+private:
+  /// State of the NFA.
+  struct Node {
+    /// Kinds of nodes.
+    enum Kind : uint8_t {
+      /// Consumes a character in Set, continuing to Out.
+      kSet,
+      /// Continues to both Out and Alt without consuming anything.
+      kSplit,
+      /// Accepts the string.
+      kAccept,
+    };
+
+    Kind Type;
+    std::bitset<256> Set;
+    int Out;
+    int Alt;
+  };
+
+  /// Fragment of the NFA, with dangling exits: 2 * node, plus 1 for Alt.
+  struct Fragment {
+    int Start;
+    std::vector<int> Exits;
+  };
+
+  /// Parser of a single pattern.
+  class Parser;
+
+  /// State of the DFA.
+  struct State {
+    /// Set if some NFA state in the set accepts.
+    bool Accept;
+    /// Successors, by character, or -1 if not built yet.
+    std::array<int, 256> Next;
+  };
+
+  /// Adds an NFA node.
+  int AddNode(Node::Kind kind, const std::bitset<256> &set = {});
+  /// Points the dangling exits of a fragment to a node.
+  void Patch(const std::vector<int> &exits, int node);
+  /// Adds the epsilon closure of a node to a set.
+  void Closure(int node, std::vector<int> &set, std::vector<bool> &seen) const;
+  /// Returns the DFA state of a set of NFA states.
+  int GetState(std::vector<int> &&set);
+  /// Builds a transition of the DFA.
+  int Step(int state, uint8_t c);
+
+private:
+  /// Nodes of the NFA.
+  std::vector<Node> nodes_;
+  /// Start state of the DFA.
+  int start_;
+  /// NFA states of each DFA state.
+  std::vector<std::vector<int>> sets_;
+  /// States of the DFA.
+  std::vector<State> states_;
+  /// DFA states, by their NFA states.
+  std::map<std::vector<int>, int> ids_;
+};
+
+/**
+ * Paths excluded from the trace by the rules of a filter file.
+ *
+ * A path matching the rules is only excluded while no process produced
+ * it, so files generated by the build are kept wherever they live. The
+ * verdict of each path is cached by ID, so the matcher runs once per
+ * unique path.
+ */
+class PathFilter final {
+public:
+  PathFilter(const std::vector<std::string> &patterns);
+
+  /// Checks if a path is excluded, counting the event as dropped if it is.
+  bool Excludes(PathID path);
+  /// Checks if a path is excluded, without counting anything.
+  bool IsExcluded(PathID path);
+  /// Records a path written, created or renamed by a process.
+  void AddProduced(PathID path);
+
+  /// Returns the number of events dropped.
+  uint64_t GetDropped() const { return dropped_; }
+
+private:
+  /// Verdicts.
+  enum Verdict : uint8_t {
+    kUnknown,
+    kKept,
+    kExcluded,
+    kProduced,
+  };
+
+  /// Returns the verdict slot of a path.
+  Verdict &Get(PathID path);
+
+  /// Compiled rules.
+  PathMatcher matcher_;
+  /// Verdict of each path, by ID.
+  std::vector<Verdict> verdicts_;
+  /// Number of events dropped.
+  uint64_t dropped_;
+};
+
+/**
+ * Returns the path filter, or nullptr if MKCHECK_FILTER is not set.
+ *
+ * The variable names a rule file in the format of fuzz_test, such as the
+ * filter.yaml written by run-mkcheck. Paths matching its `filter_in` rules
+ * are dropped from the inputs of processes, unless the build produced them.
+ */
+PathFilter *GetPathFilter();
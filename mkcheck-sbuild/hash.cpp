@@ -0,0 +1,351 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kBufferSize = 1 << 20;
+
+// -----------------------------------------------------------------------------
+static inline uint64_t Rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// -----------------------------------------------------------------------------
+static inline uint64_t Load64(const uint8_t *p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+static inline uint32_t Load32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// -----------------------------------------------------------------------------
+static inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+  acc += input * kPrime2;
+  acc = Rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+// -----------------------------------------------------------------------------
+static inline uint64_t Merge(uint64_t acc, uint64_t lane)
+{
+  acc ^= Round(0, lane);
+  return acc * kPrime1 + kPrime4;
+}
+
+
+
+// -----------------------------------------------------------------------------
+ContentHash::ContentHash()
+  : lanes_{ kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1 }
+  , tailSize_(0)
+  , total_(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+void ContentHash::Update(const void *data, size_t len)
+{
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  const uint8_t *end = p + len;
+  total_ += len;
+
+  if (tailSize_) {
+    const size_t n = std::min(len, kStripe - tailSize_);
+    memcpy(tail_ + tailSize_, p, n);
+    tailSize_ += n;
+    p += n;
+    if (tailSize_ < kStripe) {
+      return;
+    }
+    for (int i = 0; i < 4; ++i) {
+      lanes_[i] = Round(lanes_[i], Load64(tail_ + 8 * i));
+    }
+    tailSize_ = 0;
+  }
+
+  // The lanes are independent, so the rounds of a stripe overlap.
+  uint64_t v0 = lanes_[0], v1 = lanes_[1], v2 = lanes_[2], v3 = lanes_[3];
+  for (; end - p >= static_cast<ptrdiff_t>(kStripe); p += kStripe) {
+    v0 = Round(v0, Load64(p + 0));
+    v1 = Round(v1, Load64(p + 8));
+    v2 = Round(v2, Load64(p + 16));
+    v3 = Round(v3, Load64(p + 24));
+  }
+  lanes_[0] = v0; lanes_[1] = v1; lanes_[2] = v2; lanes_[3] = v3;
+
+  memcpy(tail_, p, end - p);
+  tailSize_ = end - p;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t ContentHash::Digest() const
+{
+  uint64_t h;
+  if (total_ >= kStripe) {
+    h = Rotl(lanes_[0], 1) + Rotl(lanes_[1], 7) + Rotl(lanes_[2], 12) + Rotl(lanes_[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      h = Merge(h, lanes_[i]);
+    }
+  } else {
+    h = lanes_[2] + kPrime5;
+  }
+  h += total_;
+
+  const uint8_t *p = tail_;
+  const uint8_t *end = tail_ + tailSize_;
+  for (; end - p >= 8; p += 8) {
+    h ^= Round(0, Load64(p));
+    h = Rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if (end - p >= 4) {
+    h ^= static_cast<uint64_t>(Load32(p)) * kPrime1;
+    h = Rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * kPrime5;
+    h = Rotl(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+
+
+// -----------------------------------------------------------------------------
+HashPool::HashPool(unsigned threads)
+  : busy_(0)
+  , stop_(false)
+  , seq_(0)
+{
+  for (unsigned i = 0; i < threads; ++i) {
+    threads_.emplace_back([this] { Run(); });
+  }
+}
+
+// -----------------------------------------------------------------------------
+HashPool::~HashPool()
+{
+  Wait();
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::AddInput(PathID path)
+{
+  if (path >= inputs_.size()) {
+    inputs_.resize(std::max<size_t>(path + 1, inputs_.size() * 2));
+  }
+  if (inputs_[path]) {
+    return;
+  }
+  inputs_[path] = true;
+  Push(path);
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::AddWritten(uint64_t uid, int fd, PathID path)
+{
+  written_[uid][fd] = path;
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::Close(uint64_t uid, int fd)
+{
+  auto proc = written_.find(uid);
+  if (proc == written_.end()) {
+    return;
+  }
+  auto it = proc->second.find(fd);
+  if (it == proc->second.end()) {
+    return;
+  }
+  Push(it->second);
+  proc->second.erase(it);
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::End(uint64_t uid)
+{
+  auto proc = written_.find(uid);
+  if (proc == written_.end()) {
+    return;
+  }
+  for (const auto &it : proc->second) {
+    Push(it.second);
+  }
+  written_.erase(proc);
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::AddOutput(PathID path)
+{
+  Push(path);
+}
+
+// -----------------------------------------------------------------------------
+std::vector<std::pair<PathID, uint64_t>> HashPool::Take()
+{
+  std::vector<std::pair<PathID, uint64_t>> done;
+  std::lock_guard<std::mutex> guard(lock_);
+  done.swap(done_);
+  return done;
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::Wait()
+{
+  {
+    std::unique_lock<std::mutex> guard(lock_);
+    idle_.wait(guard, [this] { return queue_.empty() && busy_ == 0; });
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+// -----------------------------------------------------------------------------
+bool HashPool::Find(PathID path, uint64_t *hash) const
+{
+  auto it = hashes_.find(path);
+  if (it == hashes_.end()) {
+    return false;
+  }
+  *hash = it->second.second;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::Push(PathID path)
+{
+  // The path table is only used by the tracer, so the name is copied.
+  Request req{ path, GetPathTable().Get(path), 0 };
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (stop_) {
+      return;
+    }
+    req.Seq = seq_++;
+    queue_.push_back(std::move(req));
+  }
+  ready_.notify_one();
+}
+
+// -----------------------------------------------------------------------------
+void HashPool::Run()
+{
+  std::vector<uint8_t> buffer(kBufferSize);
+  std::unique_lock<std::mutex> guard(lock_);
+  for (;;) {
+    ready_.wait(guard, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return;
+    }
+
+    Request req = std::move(queue_.front());
+    queue_.pop_front();
+    ++busy_;
+
+    guard.unlock();
+    uint64_t hash;
+    const bool hashed = Hash(req.Name, buffer, &hash);
+    guard.lock();
+
+    if (hashed) {
+      auto it = hashes_.emplace(req.Path, std::make_pair(req.Seq, hash));
+      if (!it.second && it.first->second.first < req.Seq) {
+        it.first->second = std::make_pair(req.Seq, hash);
+      }
+      if (it.first->second.first == req.Seq) {
+        done_.emplace_back(req.Path, hash);
+      }
+    }
+
+    if (--busy_ == 0 && queue_.empty()) {
+      idle_.notify_all();
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool HashPool::Hash(const std::string &name, std::vector<uint8_t> &buffer, uint64_t *hash)
+{
+  // Devices and pipes are skipped before they are opened, since opening
+  // or reading them could block or have side effects.
+  struct stat st;
+  if (stat(name.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+
+  const int fd = open(name.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  ContentHash h;
+  bool ok = true;
+  for (;;) {
+    const ssize_t n = read(fd, buffer.data(), buffer.size());
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      ok = false;
+      break;
+    }
+    h.Update(buffer.data(), n);
+  }
+  close(fd);
+
+  *hash = h.Digest();
+  return ok;
+}
+
+// -----------------------------------------------------------------------------
+HashPool *GetHashPool()
+{
+  static HashPool *pool = [] () -> HashPool * {
+    const char *threads = getenv("MKCHECK_HASH");
+    if (!threads || !*threads) {
+      return nullptr;
+    }
+    // Never freed: the threads are stopped when the graph is written.
+    return new HashPool(std::max(1, atoi(threads)));
+  }();
+  return pool;
+}
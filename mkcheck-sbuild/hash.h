@@ -0,0 +1,133 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "path.h"
+
+
+
+/**
+ * Returns the 64-bit fingerprint of a buffer.
+ *
+ * The construction follows xxHash64: four independent lanes consume
+ * 32-byte stripes, so the loop pipelines and vectorises well, and the
+ * lanes are merged and mixed at the end.
+ */
+class ContentHash final {
+public:
+  ContentHash();
+
+  /// Hashes more bytes.
+  void Update(const void *data, size_t len);
+  /// Returns the fingerprint of all bytes hashed so far.
+  uint64_t Digest() const;
+
+private:
+  /// Size of a stripe.
+  static constexpr size_t kStripe = 32;
+
+  /// Lanes.
+  uint64_t lanes_[4];
+  /// Bytes of the last, partial stripe.
+  uint8_t tail_[kStripe];
+  /// Number of bytes in the tail.
+  size_t tailSize_;
+  /// Number of bytes hashed.
+  uint64_t total_;
+};
+
+/**
+ * Fingerprints the contents of files on a pool of background threads.
+ *
+ * The tracer queues files it saw read for the first time, files written
+ * through an fd once the fd is closed, and the targets of renames. Queuing
+ * only takes a lock, so the tracees are resumed without waiting for the
+ * hashes; the tracer collects the results as they complete. A file hashed
+ * more than once keeps the fingerprint of the last request. Only regular
+ * files are hashed.
+ */
+class HashPool final {
+public:
+  HashPool(unsigned threads);
+  ~HashPool();
+
+  /// Queues a file read by a process, unless it was queued before.
+  void AddInput(PathID path);
+  /// Remembers a file written through an fd.
+  void AddWritten(uint64_t uid, int fd, PathID path);
+  /// Queues the file written through an fd which was closed.
+  void Close(uint64_t uid, int fd);
+  /// Queues the files still open for writing by a process which exited.
+  void End(uint64_t uid);
+  /// Queues a file written by path or renamed.
+  void AddOutput(PathID path);
+
+  /// Returns the fingerprints completed since the last call.
+  std::vector<std::pair<PathID, uint64_t>> Take();
+  /// Waits for all queued files, then stops the threads.
+  void Wait();
+  /// Returns the fingerprint of a file, after Wait.
+  bool Find(PathID path, uint64_t *hash) const;
+
+private:
+  /// File to hash.
+  struct Request {
+    PathID Path;
+    std::string Name;
+    uint64_t Seq;
+  };
+
+  /// Queues a file.
+  void Push(PathID path);
+  /// Body of the threads.
+  void Run();
+  /// Hashes a file, returning false if it is not a regular file.
+  static bool Hash(const std::string &name, std::vector<uint8_t> &buffer, uint64_t *hash);
+
+private:
+  /// Threads.
+  std::vector<std::thread> threads_;
+  /// Lock protecting the queue and the results.
+  std::mutex lock_;
+  /// Signalled when requests are queued or the pool stops.
+  std::condition_variable ready_;
+  /// Signalled when all requests are done.
+  std::condition_variable idle_;
+  /// Queued requests.
+  std::deque<Request> queue_;
+  /// Requests being hashed.
+  size_t busy_;
+  /// Set when the threads should exit.
+  bool stop_;
+  /// Sequence number of the next request.
+  uint64_t seq_;
+  /// Fingerprint of each file and the request it belongs to.
+  std::unordered_map<PathID, std::pair<uint64_t, uint64_t>> hashes_;
+  /// Fingerprints completed since the last Take.
+  std::vector<std::pair<PathID, uint64_t>> done_;
+
+  /// Files queued as inputs, by ID, only used by the tracer.
+  std::vector<bool> inputs_;
+  /// Files written through the fds of each process, only used by the tracer.
+  std::unordered_map<uint64_t, std::unordered_map<int, PathID>> written_;
+};
+
+/**
+ * Returns the hash pool, or nullptr if MKCHECK_HASH is not set.
+ *
+ * The variable holds the number of threads. The fingerprints are written to
+ * the graph (see records.h), so the pool is only useful along with it.
+ */
+HashPool *GetHashPool();
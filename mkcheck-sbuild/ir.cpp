@@ -0,0 +1,317 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "ir.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tasks.h"
+
+using namespace ir;
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kFlushSize = 64 << 10;
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kRingSize = 16 << 20;
+
+
+
+// -----------------------------------------------------------------------------
+IrWriter::IrWriter(const std::string &path, const char *ring)
+  : fd_(-1)
+  , ring_(ring ? new RingWriter(ring, path, kRingSize) : nullptr)
+  , closed_(false)
+  , pid_(0)
+  , name_("")
+{
+  if (!ring_) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+  if (!ring_ && fd_ < 0) {
+    throw std::runtime_error(
+        "Cannot open " + path + ": " + std::string(strerror(errno))
+    );
+  }
+  buffer_.reserve(kFlushSize * 2);
+  buffer_.append(kMagic, sizeof(kMagic));
+}
+
+// -----------------------------------------------------------------------------
+IrWriter::~IrWriter()
+{
+  Close();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::SetSyscall(pid_t pid, const char *name)
+{
+  pid_ = pid;
+  name_ = name;
+}
+
+// -----------------------------------------------------------------------------
+static TaskRecord *FindTask(pid_t pid)
+{
+  Tasks *tasks = GetTasks();
+  return tasks ? tasks->Find(pid) : nullptr;
+}
+
+// -----------------------------------------------------------------------------
+static bool IsSymlink(const char *name)
+{
+  return strcmp(name, "symlink") == 0 || strcmp(name, "symlinkat") == 0;
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddConsume(PathID path)
+{
+  if (TaskRecord *task = FindTask(pid_)) {
+    task->Effects[path] |= TaskRecord::kConsumed;
+    return;
+  }
+  AddPath(kConsume, pid_, name_, path);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddProduce(PathID path)
+{
+  if (TaskRecord *task = FindTask(pid_)) {
+    const bool dir = strncmp(name_, "mkdir", 5) == 0;
+    task->Effects[path] |= TaskRecord::kProduced | (dir ? TaskRecord::kDirectory : 0);
+    return;
+  }
+  AddPath(kProduce, pid_, name_, path);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddDel(PathID path)
+{
+  if (TaskRecord *task = FindTask(pid_)) {
+    task->Effects[path] |= TaskRecord::kRemoved;
+    return;
+  }
+  AddPath(kDel, pid_, name_, path);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddChdir(PathID path)
+{
+  AddPath(kChdir, pid_, name_, path);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddLink(PathID src, PathID dst)
+{
+  if (TaskRecord *task = FindTask(pid_)) {
+    task->Links.push_back({ src, dst, IsSymlink(name_) });
+    return;
+  }
+  AddPaths(kLink, pid_, name_, src, dst);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddRename(PathID from, PathID to)
+{
+  if (TaskRecord *task = FindTask(pid_)) {
+    task->Effects[to] |= TaskRecord::kProduced;
+    task->Effects[from] |= TaskRecord::kRemoved;
+    return;
+  }
+  AddPaths(kRename, pid_, name_, from, to);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddNewproc(pid_t parent, pid_t pid)
+{
+  AddHeader(kNewproc, parent, "clone");
+  AddInt(pid);
+  Flush();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddTask(pid_t pid, const TaskRecord &task)
+{
+  AddHeader(kBeginTask, pid, "write");
+  AddString(task.Begin.data(), task.Begin.size());
+
+  // Files are sorted so that the output does not depend on hashing.
+  std::vector<std::pair<PathID, uint8_t>> effects(task.Effects.begin(), task.Effects.end());
+  std::sort(effects.begin(), effects.end());
+  for (const auto &effect : effects) {
+    if (effect.second & TaskRecord::kConsumed) {
+      AddPath(kConsume, pid, "read", effect.first);
+    }
+    if (effect.second & TaskRecord::kProduced) {
+      const bool dir = effect.second & TaskRecord::kDirectory;
+      AddPath(kProduce, pid, dir ? "mkdir" : "write", effect.first);
+    }
+    if (effect.second & TaskRecord::kRemoved) {
+      AddPath(kDel, pid, "unlink", effect.first);
+    }
+  }
+  for (const TaskRecord::Link &link : task.Links) {
+    AddPaths(kLink, pid, link.Symbolic ? "symlink" : "link", link.Src, link.Dst);
+  }
+
+  AddHeader(kEndTask, pid, "write");
+  AddString(task.End.data(), task.End.size());
+  Flush();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddMarker(pid_t pid, const std::string &line)
+{
+  AddHeader(kMarker, pid, "write");
+  AddString(line.data(), line.size());
+  Flush();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddHeader(Op op, pid_t pid, const char *name)
+{
+  const size_t len = std::min<size_t>(strlen(name), UINT8_MAX);
+  buffer_.push_back(op);
+  AddInt(pid);
+  buffer_.push_back(len);
+  buffer_.append(name, len);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddPath(Op op, pid_t pid, const char *name, PathID path)
+{
+  const std::string &str = GetPathTable().Get(path);
+  AddHeader(op, pid, name);
+  AddString(str.data(), str.size());
+  Flush();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddPaths(Op op, pid_t pid, const char *name, PathID src, PathID dst)
+{
+  const std::string &srcPath = GetPathTable().Get(src);
+  const std::string &dstPath = GetPathTable().Get(dst);
+  AddHeader(op, pid, name);
+  AddString(srcPath.data(), srcPath.size());
+  AddString(dstPath.data(), dstPath.size());
+  Flush();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddInt(uint32_t value)
+{
+  const char bytes[4] = {
+      static_cast<char>(value >> 24),
+      static_cast<char>(value >> 16),
+      static_cast<char>(value >> 8),
+      static_cast<char>(value),
+  };
+  buffer_.append(bytes, sizeof(bytes));
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::AddString(const char *str, size_t len)
+{
+  AddInt(len);
+  buffer_.append(str, len);
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::Flush()
+{
+  // Records are batched: the reader only needs them by the end of the build.
+  if (buffer_.size() < kFlushSize || closed_) {
+    return;
+  }
+  if (ring_) {
+    ring_->Publish(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    return;
+  }
+
+  const char *ptr = buffer_.data();
+  size_t len = buffer_.size();
+  while (len > 0) {
+    const ssize_t n = write(fd_, ptr, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("Cannot write IR: " + std::string(strerror(errno)));
+    }
+    ptr += n;
+    len -= n;
+  }
+  buffer_.clear();
+}
+
+// -----------------------------------------------------------------------------
+void IrWriter::Close()
+{
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+
+  if (ring_) {
+    if (!buffer_.empty()) {
+      ring_->Publish(buffer_.data(), buffer_.size());
+    }
+    ring_->Close();
+    buffer_.clear();
+    return;
+  }
+
+  // A reader gone away is not worth reporting at exit.
+  const char *ptr = buffer_.data();
+  size_t len = buffer_.size();
+  while (len > 0) {
+    const ssize_t n = write(fd_, ptr, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    ptr += n;
+    len -= n;
+  }
+  buffer_.clear();
+  close(fd_);
+  fd_ = -1;
+}
+
+// -----------------------------------------------------------------------------
+static void CloseIrWriter()
+{
+  GetIrWriter()->Close();
+}
+
+// -----------------------------------------------------------------------------
+IrWriter *GetIrWriter()
+{
+  static IrWriter *writer = [] () -> IrWriter * {
+    const char *path = getenv("MKCHECK_IR");
+    if (!path || !*path) {
+      return nullptr;
+    }
+
+    // Never freed: the stream is flushed by an exit handler.
+    const char *ring = getenv("MKCHECK_IR_RING");
+    IrWriter *w = new IrWriter(path, ring && *ring ? ring : nullptr);
+    atexit(CloseIrWriter);
+    return w;
+  }();
+  return writer;
+}
@@ -0,0 +1,142 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "path.h"
+#include "ring.h"
+
+struct TaskRecord;
+
+
+
+/**
+ * Statements of the BuildFS trace IR, in binary.
+ *
+ * The stream starts with an 8-byte magic, followed by records which start
+ * with an opcode, the PID of the process and the name of the syscall which
+ * caused the statement. Integers are 32-bit big-endian, names are prefixed
+ * by their 8-bit length and paths by their 32-bit length. Paths are always
+ * absolute and normalised, so the stream never refers to descriptors or to
+ * the working directory of a process.
+ *
+ * Files touched by processes running a build task (see tasks.h) are
+ * written as a single block when the task ends: the begin marker, one
+ * record per file and effect, then the end marker.
+ */
+namespace ir {
+
+/// Magic identifying the format and its version.
+constexpr char kMagic[8] = { 'B', 'F', 'S', 'I', 'R', '0', '0', '1' };
+
+/// Opcodes of records.
+enum Op : uint8_t {
+  /// consume path
+  kConsume = 1,
+  /// produce path
+  kProduce = 2,
+  /// del path
+  kDel = 3,
+  /// let cwd = path
+  kChdir = 4,
+  /// newproc pid
+  kNewproc = 5,
+  /// produce dst, consume src unless the link is symbolic: src, dst
+  kLink = 6,
+  /// produce dst, del src: src, dst
+  kRename = 7,
+  /// begin task: marker
+  kBeginTask = 8,
+  /// end task: marker
+  kEndTask = 9,
+  /// other markers of the build tool: marker
+  kMarker = 10,
+};
+
+}
+
+/**
+ * Writes the statements of the handlers to a file or a pipe.
+ *
+ * Records are buffered and written out in large chunks. The handler sets
+ * the syscall the following statements are attributed to. Statements of
+ * processes which run a task are added to the task instead.
+ */
+class IrWriter final {
+public:
+  /// Writes to a file, or publishes to a ring if one is given.
+  IrWriter(const std::string &path, const char *ring);
+  ~IrWriter();
+
+  /// Attributes the following statements to a syscall.
+  void SetSyscall(pid_t pid, const char *name);
+
+  /// A file was read or inspected.
+  void AddConsume(PathID path);
+  /// A file was written or created.
+  void AddProduce(PathID path);
+  /// A file was removed.
+  void AddDel(PathID path);
+  /// The working directory changed.
+  void AddChdir(PathID path);
+  /// A file was linked.
+  void AddLink(PathID src, PathID dst);
+  /// A file was renamed.
+  void AddRename(PathID from, PathID to);
+  /// A process was created by fork, vfork or clone.
+  void AddNewproc(pid_t parent, pid_t pid);
+  /// A task ended, started by a process.
+  void AddTask(pid_t pid, const TaskRecord &task);
+  /// A marker of the build tool which does not delimit tasks.
+  void AddMarker(pid_t pid, const std::string &line);
+
+  /// Writes out the buffered records and closes the stream.
+  void Close();
+
+  /// Returns the ring the records are published to, or nullptr.
+  const RingWriter *GetRing() const { return ring_.get(); }
+
+private:
+  /// Writes the header of a record.
+  void AddHeader(ir::Op op, pid_t pid, const char *name);
+  /// Writes a record with a single path.
+  void AddPath(ir::Op op, pid_t pid, const char *name, PathID path);
+  /// Writes a record with two paths.
+  void AddPaths(ir::Op op, pid_t pid, const char *name, PathID src, PathID dst);
+  /// Appends a 32-bit integer.
+  void AddInt(uint32_t value);
+  /// Appends a string prefixed by its length.
+  void AddString(const char *str, size_t len);
+  /// Writes out the buffered records.
+  void Flush();
+
+private:
+  /// Output file descriptor, unless writing to a ring.
+  int fd_;
+  /// Ring, if the stream goes through shared memory.
+  std::unique_ptr<RingWriter> ring_;
+  /// Set once the stream was closed.
+  bool closed_;
+  /// Records not written yet.
+  std::string buffer_;
+  /// Process of the current syscall.
+  pid_t pid_;
+  /// Name of the current syscall.
+  const char *name_;
+};
+
+/**
+ * Returns the IR writer, or nullptr if MKCHECK_IR is not set.
+ *
+ * The variable names a file; /dev/fd/N sends the stream to an inherited
+ * pipe, which is how BuildFS runs its online analysis. If MKCHECK_IR_RING
+ * names a file as well, the stream goes through a ring mapped there and
+ * MKCHECK_IR only serves as its doorbell.
+ */
+IrWriter *GetIrWriter();
@@ -0,0 +1,31 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+
+
+/**
+ * Escapes a string for inclusion in a JSON string literal.
+ */
+inline std::string EscapeJson(const std::string &str)
+{
+  std::string out;
+  out.reserve(str.size());
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out.append(buf);
+    } else {
+      out.push_back(c);
+    }
+  }
+  return out;
+}
@@ -0,0 +1,151 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "lifecycle.h"
+
+#include <string>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include "eventlog.h"
+#include "fdevents.h"
+#include "fdtable.h"
+#include "hash.h"
+#include "ir.h"
+#include "metrics.h"
+#include "path.h"
+#include "profile.h"
+#include "proc.h"
+#include "records.h"
+#include "tasks.h"
+#include "trace.h"
+#include "uring.h"
+
+
+
+// -----------------------------------------------------------------------------
+void OnSpawn(Trace *trace, pid_t parent, pid_t pid, uint64_t flags)
+{
+  if (EventWriter *writer = GetEventWriter()) {
+    writer->AddSpawn(parent, pid, flags);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddNewproc(parent, pid);
+  }
+
+  // The child is profiled before the tasks table can assign it a task.
+  const uint64_t uid = trace->GetTrace(pid)->GetUID();
+  const uint64_t parentUID = trace->GetTrace(parent)->GetUID();
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->Spawn(parentUID, uid, pid);
+  }
+  if (Tasks *tasks = GetTasks()) {
+    tasks->Spawn(parent, pid);
+  }
+
+  ResolveCache &cache = GetResolveCache();
+  PathID cwd;
+  if (cache.GetCwd(parentUID, &cwd)) {
+    cache.SetCwd(uid, cwd);
+  }
+  FdTables &fds = GetFdTables();
+  fds.Spawn(parentUID, uid, flags & CLONE_FILES);
+  if (!(flags & CLONE_FILES)) {
+    // The child inherits the ring fds and their mappings.
+    GetUringTable().Fork(fds.GetID(parentUID), fds.GetID(uid));
+  }
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->Spawn(uid, parentUID);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void OnStart(Trace *trace, pid_t pid, const std::string &cwd)
+{
+  const Process *proc = trace->GetTrace(pid);
+  const uint64_t uid = proc->GetUID();
+  const PathID image = proc->GetImage();
+
+  PathTable &table = GetPathTable();
+  if (EventWriter *writer = GetEventWriter()) {
+    writer->AddStart(pid, table.Get(image), cwd);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->SetSyscall(pid, "execve");
+    ir->AddConsume(image);
+  }
+
+  // The root inherits the standard streams of the tracer.
+  if (!cwd.empty()) {
+    GetResolveCache().SetCwd(uid, table.Intern(cwd));
+  }
+  FdTables &fds = GetFdTables();
+  fds.Map(uid, STDIN_FILENO, table.Intern("/dev/stdin"));
+  fds.Map(uid, STDOUT_FILENO, table.Intern("/dev/stdout"));
+  fds.Map(uid, STDERR_FILENO, table.Intern("/dev/stderr"));
+
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->Spawn(uid, 0);
+    records->SetImage(uid, image);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->Start(uid, pid);
+    profiler->SetImage(uid, image);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void OnExec(Trace *trace, pid_t pid)
+{
+  const Process *proc = trace->GetTrace(pid);
+  const uint64_t uid = proc->GetUID();
+  const PathID image = proc->GetImage();
+
+  const std::string &name = GetPathTable().Get(image);
+  if (EventWriter *writer = GetEventWriter()) {
+    writer->AddStart(pid, name, "");
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->SetSyscall(pid, "execve");
+    ir->AddConsume(image);
+  }
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->SetImage(uid, image);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->SetImage(uid, image);
+  }
+  if (Metrics *metrics = GetMetrics()) {
+    metrics->SetImage(pid, name);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void OnEnd(Trace *trace, pid_t pid)
+{
+  if (EventWriter *writer = GetEventWriter()) {
+    writer->AddEnd(pid);
+  }
+  if (Tasks *tasks = GetTasks()) {
+    tasks->End(pid);
+  }
+
+  // The process is frozen: nothing refers to its descriptors any more.
+  const uint64_t uid = trace->GetTrace(pid)->GetUID();
+  GetFdEvents().Drop(uid);
+  const uint64_t table = GetFdTables().GetID(uid);
+  if (GetFdTables().Drop(uid)) {
+    GetUringTable().Drop(table);
+  }
+  GetResolveCache().DropCwd(uid);
+  if (HashPool *pool = GetHashPool()) {
+    pool->End(uid);
+  }
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->End(uid);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->End(uid);
+  }
+}
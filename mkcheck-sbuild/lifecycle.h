@@ -0,0 +1,37 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+class Trace;
+
+
+
+/**
+ * Process lifecycle hooks, called by the trace (see trace.h).
+ *
+ * They maintain the fd tables and cwds of the handlers and forward events
+ * to the optional outputs of the tracer: the event log, the graph records,
+ * the BuildFS IR and the profile.
+ * OnSpawn must be called on the clone event, before the parent or the
+ * child is resumed, and OnExec on the exec event, before execve returns.
+ * The hooks are called after the trace registers the process and before it
+ * is discarded.
+ */
+
+/// A process was created by fork, vfork or clone, with the clone flags.
+void OnSpawn(Trace *trace, pid_t parent, pid_t pid, uint64_t flags);
+
+/// The root process started running its image in a directory.
+void OnStart(Trace *trace, pid_t pid, const std::string &cwd);
+
+/// A process replaced its image.
+void OnExec(Trace *trace, pid_t pid);
+
+/// A process exited.
+void OnEnd(Trace *trace, pid_t pid);
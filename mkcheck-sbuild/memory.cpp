@@ -0,0 +1,292 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "eventlog.h"
+#include "metrics.h"
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kMaxString = 1 << 20;
+
+// -----------------------------------------------------------------------------
+static uint64_t peekFallbacks = 0;
+
+// -----------------------------------------------------------------------------
+static bool vmReadvMissing = false;
+
+// -----------------------------------------------------------------------------
+static GuestMemory *source = nullptr;
+
+// -----------------------------------------------------------------------------
+static std::unordered_map<pid_t, std::vector<std::pair<uint64_t, std::string>>>
+prefetched;
+
+// -----------------------------------------------------------------------------
+static size_t PageSize()
+{
+  static const size_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+// -----------------------------------------------------------------------------
+static size_t ToPageEnd(uint64_t addr)
+{
+  return PageSize() - (addr & (PageSize() - 1));
+}
+
+// -----------------------------------------------------------------------------
+static void PeekBuffer(pid_t pid, void *buf, uint64_t addr, size_t len)
+{
+  uint8_t *dst = static_cast<uint8_t *>(buf);
+  while (len > 0) {
+    errno = 0;
+    const long word = ptrace(PTRACE_PEEKDATA, pid, addr, nullptr);
+    if (errno != 0) {
+      throw std::runtime_error(
+          "Cannot read memory of " + std::to_string(pid) + ": " +
+          strerror(errno)
+      );
+    }
+
+    const size_t n = std::min(len, sizeof(word));
+    memcpy(dst, &word, n);
+    dst += n;
+    addr += n;
+    len -= n;
+  }
+}
+
+// -----------------------------------------------------------------------------
+static std::string PeekString(pid_t pid, uint64_t addr)
+{
+  std::string str;
+  for (;;) {
+    char word[sizeof(long)];
+    PeekBuffer(pid, word, addr, sizeof(word));
+    if (const void *nul = memchr(word, '\0', sizeof(word))) {
+      str.append(word, static_cast<const char *>(nul) - word);
+      return str;
+    }
+    if (str.size() > kMaxString) {
+      throw std::runtime_error("String argument too long");
+    }
+    str.append(word, sizeof(word));
+    addr += sizeof(word);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static ssize_t VmReadv(
+    pid_t pid,
+    const std::vector<iovec> &local,
+    const std::vector<iovec> &remote)
+{
+  if (vmReadvMissing) {
+    return -1;
+  }
+
+  const ssize_t n = process_vm_readv(
+      pid,
+      local.data(),
+      local.size(),
+      remote.data(),
+      remote.size(),
+      0
+  );
+  if (n < 0 && errno == ENOSYS) {
+    vmReadvMissing = true;
+  }
+  return n;
+}
+
+// -----------------------------------------------------------------------------
+void SetGuestMemory(GuestMemory *memory)
+{
+  source = memory;
+}
+
+// -----------------------------------------------------------------------------
+void ReadGuestBuffer(pid_t pid, void *buf, uint64_t addr, size_t len)
+{
+  if (source) {
+    source->ReadBuffer(pid, buf, addr, len);
+    return;
+  }
+
+  std::vector<iovec> local{ { buf, len } };
+  std::vector<iovec> remote;
+  for (uint64_t ptr = addr, end = addr + len; ptr < end; ) {
+    const size_t n = std::min<uint64_t>(ToPageEnd(ptr), end - ptr);
+    remote.push_back({ reinterpret_cast<void *>(ptr), n });
+    ptr += n;
+  }
+
+  // Pages are separate iovecs, so a short read stops at the first bad page.
+  const ssize_t n = VmReadv(pid, local, remote);
+  const size_t done = n < 0 ? 0 : n;
+  if (done < len) {
+    ++peekFallbacks;
+    PeekBuffer(pid, static_cast<uint8_t *>(buf) + done, addr + done, len - done);
+  }
+
+  if (Metrics *metrics = GetMetrics()) {
+    metrics->AddBytesRead(pid, len);
+  }
+  if (EventWriter *writer = GetEventWriter()) {
+    writer->AddRegion(addr, buf, len);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void ReadStrings(pid_t pid, const uint64_t *addrs, std::string *strs, size_t n)
+{
+  auto it = prefetched.find(pid);
+
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < n; ++i) {
+    strs[i].clear();
+    if (it != prefetched.end()) {
+      bool found = false;
+      for (const auto &str : it->second) {
+        if (str.first == addrs[i]) {
+          strs[i] = str.second;
+          found = true;
+          break;
+        }
+      }
+      if (found) {
+        continue;
+      }
+    }
+    if (source) {
+      strs[i] = source->ReadString(pid, addrs[i]);
+      continue;
+    }
+    pending.push_back(i);
+  }
+
+  // Strings served from the prefetched ones or from a log allocate nothing
+  // besides themselves.
+  if (pending.empty()) {
+    return;
+  }
+
+  size_t bytes = 0;
+  std::vector<uint64_t> cursor(addrs, addrs + n);
+  std::vector<char> chunk;
+  std::vector<iovec> local;
+  std::vector<iovec> remote;
+  while (!pending.empty()) {
+    // Read the rest of the current page of each unterminated string.
+    size_t total = 0;
+    for (size_t i : pending) {
+      total += ToPageEnd(cursor[i]);
+    }
+    chunk.resize(total);
+
+    local.clear();
+    remote.clear();
+    size_t off = 0;
+    for (size_t i : pending) {
+      const size_t len = ToPageEnd(cursor[i]);
+      local.push_back({ chunk.data() + off, len });
+      remote.push_back({ reinterpret_cast<void *>(cursor[i]), len });
+      off += len;
+    }
+
+    const ssize_t read = VmReadv(pid, local, remote);
+    size_t avail = read < 0 ? 0 : read;
+    bytes += avail;
+
+    std::vector<size_t> next;
+    for (size_t k = 0; k < pending.size(); ++k) {
+      const size_t i = pending[k];
+      const char *data = static_cast<const char *>(local[k].iov_base);
+      const size_t len = local[k].iov_len;
+
+      if (avail < len) {
+        // The read stopped at this page: the kernel denied access or the
+        // page is not mapped. PEEKDATA either succeeds or reports it.
+        ++peekFallbacks;
+        const size_t size = strs[i].size();
+        strs[i].append(PeekString(pid, cursor[i]));
+        bytes += strs[i].size() - size;
+        avail = 0;
+        continue;
+      }
+      avail -= len;
+
+      if (const void *nul = memchr(data, '\0', len)) {
+        strs[i].append(data, static_cast<const char *>(nul) - data);
+        continue;
+      }
+      if (strs[i].size() > kMaxString) {
+        throw std::runtime_error("String argument too long");
+      }
+      strs[i].append(data, len);
+      cursor[i] += len;
+      next.push_back(i);
+    }
+    pending.swap(next);
+  }
+
+  if (Metrics *metrics = GetMetrics()) {
+    if (bytes) {
+      metrics->AddBytesRead(pid, bytes);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void ReadGuestStrings(pid_t pid, const uint64_t *addrs, std::string *strs, size_t n)
+{
+  ReadStrings(pid, addrs, strs, n);
+
+  // Strings are logged with their terminator, as the handler saw them.
+  if (EventWriter *writer = GetEventWriter()) {
+    if (!source) {
+      for (size_t i = 0; i < n; ++i) {
+        writer->AddRegion(addrs[i], strs[i].c_str(), strs[i].size() + 1);
+      }
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+void PrefetchGuestStrings(pid_t pid, const uint64_t *addrs, size_t n)
+{
+  std::vector<std::string> strs(n);
+  ReadStrings(pid, addrs, strs.data(), n);
+
+  auto &cache = prefetched[pid];
+  for (size_t i = 0; i < n; ++i) {
+    cache.emplace_back(addrs[i], std::move(strs[i]));
+  }
+}
+
+// -----------------------------------------------------------------------------
+void DropGuestStrings(pid_t pid)
+{
+  prefetched.erase(pid);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t GetPeekFallbacks()
+{
+  return peekFallbacks;
+}
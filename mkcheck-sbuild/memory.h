@@ -0,0 +1,87 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+
+
+/**
+ * Source of tracee memory standing in for live processes, for replays.
+ */
+class GuestMemory {
+public:
+  virtual ~GuestMemory() = default;
+
+  /// Reads a buffer.
+  virtual void ReadBuffer(pid_t pid, void *buf, uint64_t addr, size_t len) = 0;
+  /// Reads a NUL-terminated string.
+  virtual std::string ReadString(pid_t pid, uint64_t addr) = 0;
+};
+
+/**
+ * Redirects all reads to a source, or back to the tracees if null.
+ */
+void SetGuestMemory(GuestMemory *memory);
+
+/**
+ * Reads a buffer from the memory of a stopped tracee.
+ *
+ * The read is split at page boundaries and issued as a single
+ * process_vm_readv scatter read. If the kernel or the tracee denies it,
+ * the missing bytes are fetched word by word with PTRACE_PEEKDATA.
+ */
+void ReadGuestBuffer(pid_t pid, void *buf, uint64_t addr, size_t len);
+
+/**
+ * Reads several NUL-terminated strings from a stopped tracee.
+ *
+ * All strings are fetched together: each round of process_vm_readv reads
+ * the remainder of the current page of every unterminated string, so
+ * typical paths need a single call regardless of the number of arguments.
+ */
+void ReadGuestStrings(pid_t pid, const uint64_t *addrs, std::string *strs, size_t n);
+
+/**
+ * Reads a single NUL-terminated string from a stopped tracee.
+ */
+inline std::string ReadGuestString(pid_t pid, uint64_t addr)
+{
+  std::string str;
+  ReadGuestStrings(pid, &addr, &str, 1);
+  return str;
+}
+
+/**
+ * Reads a fixed number of strings, for syscalls taking multiple paths.
+ */
+template<size_t N>
+std::array<std::string, N> ReadGuestStrings(pid_t pid, const uint64_t (&addrs)[N])
+{
+  std::array<std::string, N> strs;
+  ReadGuestStrings(pid, addrs, strs.data(), N);
+  return strs;
+}
+
+/**
+ * Reads strings ahead of the syscall exit, while the tracee cannot change
+ * them. Later ReadGuestStrings calls for the same addresses are served
+ * from the copies until DropGuestStrings is called.
+ */
+void PrefetchGuestStrings(pid_t pid, const uint64_t *addrs, size_t n);
+
+/**
+ * Discards the strings prefetched for a process.
+ */
+void DropGuestStrings(pid_t pid);
+
+/**
+ * Returns the number of reads which fell back to PTRACE_PEEKDATA.
+ */
+uint64_t GetPeekFallbacks();
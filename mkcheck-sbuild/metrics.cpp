@@ -0,0 +1,302 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "diag.h"
+#include "filter.h"
+#include "ir.h"
+#include "json.h"
+#include "memory.h"
+#include "path.h"
+#include "profile.h"
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr uint64_t kSnapshotCheck = 1024;
+
+// -----------------------------------------------------------------------------
+static constexpr int64_t kMaxSyscall = 1024;
+
+// -----------------------------------------------------------------------------
+static const char *kStopNames[] = {
+  "syscall_entry",
+  "syscall_exit",
+  "seccomp",
+  "event",
+  "signal",
+};
+
+// -----------------------------------------------------------------------------
+uint64_t GetTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// -----------------------------------------------------------------------------
+Metrics::Metrics(const std::string &path, uint64_t interval)
+  : path_(path)
+  , interval_(interval)
+  , start_(GetTime())
+  , lastSnapshot_(start_)
+{
+}
+
+// -----------------------------------------------------------------------------
+Metrics::SyscallStats *Metrics::GetSyscall(int64_t sno)
+{
+  // Numbers of foreign ABIs would blow up the table.
+  if (sno < 0 || sno >= kMaxSyscall) {
+    return nullptr;
+  }
+  if (sno >= static_cast<int64_t>(syscalls_.size())) {
+    syscalls_.resize(sno + 1);
+  }
+  return &syscalls_[sno];
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::AddStop(pid_t pid, Stop kind)
+{
+  ++stops_[static_cast<size_t>(kind)];
+  ++procs_[pid].Stops;
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::AddSyscallStops(int64_t sno, unsigned stops)
+{
+  if (SyscallStats *sys = GetSyscall(sno)) {
+    sys->Stops += stops;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::BeginSyscall(pid_t pid, int64_t sno)
+{
+  sno_ = sno;
+  pid_ = pid;
+  bytesRead_ = 0;
+  normaliseNs_ = 0;
+
+  auto it = prefetched_.find(pid);
+  if (it != prefetched_.end()) {
+    bytesRead_ = it->second;
+    prefetched_.erase(it);
+  }
+  begin_ = GetTime();
+}
+
+// -----------------------------------------------------------------------------
+bool Metrics::EndSyscall(bool dropped)
+{
+  const uint64_t end = GetTime();
+  const uint64_t ns = end - begin_;
+
+  uint64_t calls = 0;
+  if (SyscallStats *sys = GetSyscall(sno_)) {
+    calls = ++sys->Calls;
+    sys->Dropped += dropped ? 1 : 0;
+    sys->HandlerNs += ns;
+    sys->BytesRead += bytesRead_;
+    sys->NormaliseNs += normaliseNs_;
+    sys->Histogram[std::min<size_t>(ns ? 63 - __builtin_clzll(ns) : 0, kBuckets - 1)]++;
+  }
+
+  ProcessStats &proc = procs_[pid_];
+  proc.Calls++;
+  proc.HandlerNs += ns;
+  proc.BytesRead += bytesRead_;
+
+  sno_ = -1;
+
+  if (interval_ && calls % kSnapshotCheck == 0 && end - lastSnapshot_ >= interval_) {
+    lastSnapshot_ = end;
+    Dump(path_ + ".snapshot");
+  }
+  return proc.Calls == 1;
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::SetImage(pid_t pid, const std::string &image)
+{
+  procs_[pid].Image = image;
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::AddBytesRead(pid_t pid, size_t bytes)
+{
+  if (sno_ >= 0 && pid == pid_) {
+    bytesRead_ += bytes;
+  } else {
+    prefetched_[pid] += bytes;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::AddNormaliseTime(uint64_t ns)
+{
+  normaliseNs_ += ns;
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::AddWaitTime(uint64_t ns)
+{
+  waitNs_ += ns;
+}
+
+// -----------------------------------------------------------------------------
+void Metrics::Dump(const std::string &path) const
+{
+  // Written to a temporary first, so readers never see a partial report.
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream os(tmp);
+
+    // Peak memory of the tracer alone, excluding the tracees.
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    os << "{" << std::endl;
+    os << "  \"elapsed_ns\": " << GetTime() - start_ << "," << std::endl;
+    os << "  \"peak_rss_kb\": " << usage.ru_maxrss << "," << std::endl;
+    os << "  \"wait_ns\": " << waitNs_ << "," << std::endl;
+    uint64_t stops = 0;
+    for (uint64_t n : stops_) {
+      stops += n;
+    }
+    os << "  \"stops\": " << stops << "," << std::endl;
+    os << "  \"stop_kinds\": {";
+    for (size_t i = 0; i < stops_.size(); ++i) {
+      os << (i ? ", " : " ") << "\"" << kStopNames[i] << "\": " << stops_[i];
+    }
+    os << " }," << std::endl;
+    os << "  \"peek_fallbacks\": " << GetPeekFallbacks() << "," << std::endl;
+    os << "  \"paths\": " << GetPathTable().Size() << "," << std::endl;
+    os << "  \"resolve_hits\": " << GetResolveCache().GetHits() << "," << std::endl;
+    os << "  \"resolve_misses\": " << GetResolveCache().GetMisses() << "," << std::endl;
+    if (PathFilter *filter = GetPathFilter()) {
+      os << "  \"filter_dropped\": " << filter->GetDropped() << "," << std::endl;
+    }
+    if (IrWriter *ir = GetIrWriter()) {
+      if (const RingWriter *ring = ir->GetRing()) {
+        const ring::Header &stats = ring->GetHeader();
+        os << "  \"ring_batches\": " << stats.Batches << "," << std::endl;
+        os << "  \"ring_full\": " << stats.Full << "," << std::endl;
+        os << "  \"ring_spilled_batches\": " << stats.SpilledBatches << "," << std::endl;
+        os << "  \"ring_spilled_bytes\": " << stats.SpilledBytes << "," << std::endl;
+        os << "  \"ring_peak_bytes\": " << stats.Peak << "," << std::endl;
+      }
+    }
+
+    os << "  \"syscalls\": [" << std::endl;
+    bool first = true;
+    for (size_t sno = 0; sno < syscalls_.size(); ++sno) {
+      const SyscallStats &sys = syscalls_[sno];
+      if (sys.Stops == 0 && sys.Calls == 0) {
+        continue;
+      }
+      os << (first ? "" : ",\n");
+      os << "    { \"sno\": " << sno
+         << ", \"stops\": " << sys.Stops
+         << ", \"calls\": " << sys.Calls
+         << ", \"dropped\": " << sys.Dropped
+         << ", \"handler_ns\": " << sys.HandlerNs
+         << ", \"bytes_read\": " << sys.BytesRead
+         << ", \"normalise_ns\": " << sys.NormaliseNs
+         << ", \"histogram\": [";
+      for (size_t i = 0; i < kBuckets; ++i) {
+        os << (i ? ", " : "") << sys.Histogram[i];
+      }
+      os << "] }";
+      first = false;
+    }
+    os << std::endl << "  ]," << std::endl;
+
+    os << "  \"diagnostics\": [" << std::endl;
+    GetDiagnostics().Dump(os);
+    os << std::endl << "  ]," << std::endl;
+
+    os << "  \"procs\": [" << std::endl;
+    first = true;
+    for (const auto &it : procs_) {
+      const ProcessStats &proc = it.second;
+      os << (first ? "" : ",\n");
+      os << "    { \"pid\": " << it.first
+         << ", \"image\": \"" << EscapeJson(proc.Image) << "\""
+         << ", \"stops\": " << proc.Stops
+         << ", \"calls\": " << proc.Calls
+         << ", \"handler_ns\": " << proc.HandlerNs
+         << ", \"bytes_read\": " << proc.BytesRead
+         << " }";
+      first = false;
+    }
+    os << std::endl << "  ]" << std::endl;
+    os << "}" << std::endl;
+  }
+  rename(tmp.c_str(), path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+static void DumpMetrics()
+{
+  GetMetrics()->Dump();
+}
+
+// -----------------------------------------------------------------------------
+Metrics *GetMetrics()
+{
+  static Metrics *metrics = [] () -> Metrics * {
+    const char *path = getenv("MKCHECK_METRICS");
+    if (!path || !*path) {
+      return nullptr;
+    }
+
+    uint64_t interval = 0;
+    if (const char *secs = getenv("MKCHECK_METRICS_INTERVAL")) {
+      interval = strtoull(secs, nullptr, 10) * 1000000000ull;
+    }
+
+    // Never freed: the report is written by an exit handler.
+    Metrics *m = new Metrics(path, interval);
+    atexit(DumpMetrics);
+    return m;
+  }();
+  return metrics;
+}
+
+// -----------------------------------------------------------------------------
+pid_t WaitTracee(pid_t pid, int *status, int options)
+{
+  // The usage of a process is only available when it is reaped.
+  Profiler *profiler = GetProfiler();
+  struct rusage usage;
+  auto wait = [&] {
+    const pid_t ret = wait4(pid, status, options, profiler ? &usage : nullptr);
+    if (profiler && ret > 0 && status && (WIFEXITED(*status) || WIFSIGNALED(*status))) {
+      profiler->SetUsage(ret, usage);
+    }
+    return ret;
+  };
+
+  Metrics *metrics = GetMetrics();
+  if (!metrics) {
+    return wait();
+  }
+
+  const uint64_t start = GetTime();
+  const pid_t ret = wait();
+  metrics->AddWaitTime(GetTime() - start);
+  return ret;
+}
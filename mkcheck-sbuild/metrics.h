@@ -0,0 +1,141 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+
+
+/**
+ * Instrumentation of the tracer itself.
+ *
+ * Enabled by setting MKCHECK_METRICS to the path of the report, which is
+ * written as JSON when the tracer exits. Stops are counted by the tracer
+ * loop as they are taken, including those of ignored syscalls; calls and
+ * the handler time histograms only cover the syscalls passed to a handler. If MKCHECK_METRICS_INTERVAL is
+ * set to a number of seconds, a snapshot is also written periodically to
+ * the same path, with a .snapshot suffix.
+ */
+class Metrics final {
+public:
+  /// Number of buckets of the handler time histograms.
+  static constexpr size_t kBuckets = 32;
+
+  /// Kinds of ptrace stops.
+  enum class Stop {
+    kSyscallEntry,
+    kSyscallExit,
+    kSeccomp,
+    kEvent,
+    kSignal,
+  };
+
+public:
+  Metrics(const std::string &path, uint64_t interval);
+
+  /// Counts a stop of a tracee.
+  void AddStop(pid_t pid, Stop kind);
+  /// Attributes the stops taken by a syscall, at its exit, to its number.
+  void AddSyscallStops(int64_t sno, unsigned stops);
+
+  /// Starts accounting for a syscall handled by the tracer.
+  void BeginSyscall(pid_t pid, int64_t sno);
+  /// Ends accounting for the current syscall, returns true on the first
+  /// syscall of a process.
+  bool EndSyscall(bool dropped);
+
+  /// Records the image of a process.
+  void SetImage(pid_t pid, const std::string &image);
+
+  /// Adds bytes read from the memory of a tracee to its current syscall.
+  void AddBytesRead(pid_t pid, size_t bytes);
+  /// Adds time spent normalising paths to the current syscall.
+  void AddNormaliseTime(uint64_t ns);
+  /// Adds time spent blocked waiting for tracees.
+  void AddWaitTime(uint64_t ns);
+
+  /// Writes the report.
+  void Dump(const std::string &path) const;
+  /// Writes the final report to the configured path.
+  void Dump() const { Dump(path_); }
+
+private:
+  /// Counters of a syscall number.
+  struct SyscallStats {
+    uint64_t Stops = 0;
+    uint64_t Calls = 0;
+    uint64_t Dropped = 0;
+    uint64_t HandlerNs = 0;
+    uint64_t BytesRead = 0;
+    uint64_t NormaliseNs = 0;
+    std::array<uint64_t, kBuckets> Histogram{};
+  };
+
+  /// Counters of a process.
+  struct ProcessStats {
+    std::string Image;
+    uint64_t Stops = 0;
+    uint64_t Calls = 0;
+    uint64_t HandlerNs = 0;
+    uint64_t BytesRead = 0;
+  };
+
+private:
+  /// Returns the counters of a syscall number, or nullptr if out of range.
+  SyscallStats *GetSyscall(int64_t sno);
+
+private:
+  /// Path to the report.
+  const std::string path_;
+  /// Interval between snapshots, in nanoseconds, 0 if disabled.
+  const uint64_t interval_;
+  /// Start of the trace.
+  const uint64_t start_;
+  /// Time of the last snapshot.
+  uint64_t lastSnapshot_;
+
+  /// Syscall being handled.
+  int64_t sno_ = -1;
+  /// Process running the syscall being handled.
+  pid_t pid_ = 0;
+  /// Start of the handler of the current syscall.
+  uint64_t begin_ = 0;
+  /// Bytes read for the current syscall.
+  uint64_t bytesRead_ = 0;
+  /// Bytes read at syscall entry, before the handler runs.
+  std::unordered_map<pid_t, uint64_t> prefetched_;
+  /// Normalisation time of the current syscall.
+  uint64_t normaliseNs_ = 0;
+
+  /// Time spent in waitpid.
+  uint64_t waitNs_ = 0;
+  /// Number of stops, by kind.
+  std::array<uint64_t, 5> stops_{};
+  /// Per-syscall counters, indexed by number.
+  std::vector<SyscallStats> syscalls_;
+  /// Per-process counters.
+  std::unordered_map<pid_t, ProcessStats> procs_;
+};
+
+/**
+ * Returns the metrics of the tracer, or nullptr if they are disabled.
+ */
+Metrics *GetMetrics();
+
+/**
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+uint64_t GetTime();
+
+/**
+ * waitpid, accounting for the time spent blocked in the metrics.
+ */
+pid_t WaitTracee(pid_t pid, int *status, int options);
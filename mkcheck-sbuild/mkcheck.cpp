@@ -0,0 +1,321 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <getopt.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "metrics.h"
+#include "seccomp.h"
+#include "trace.h"
+
+
+
+// Options missing from older C library headers.
+#ifndef PTRACE_O_TRACESECCOMP
+#define PTRACE_O_TRACESECCOMP (1 << 7)
+#endif
+#ifndef PTRACE_O_EXITKILL
+#define PTRACE_O_EXITKILL (1 << 20)
+#endif
+#ifndef PTRACE_EVENT_SECCOMP
+#define PTRACE_EVENT_SECCOMP 7
+#endif
+
+/// State of a tracee, kept by the loop.
+struct Tracee {
+  /// Set between the entry and the exit stop of a syscall.
+  bool InSyscall = false;
+  /// Set until the SIGSTOP a new tracee starts with is seen.
+  bool Starting = false;
+};
+
+
+
+// -----------------------------------------------------------------------------
+static std::runtime_error Error(const std::string &what)
+{
+  return std::runtime_error(what + ": " + strerror(errno));
+}
+
+// -----------------------------------------------------------------------------
+static void RunChild(char **argv, bool seccomp)
+{
+  if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+    std::cerr << "[Error] Cannot trace: " << strerror(errno) << std::endl;
+    _exit(EXIT_FAILURE);
+  }
+
+  // The tracer sets its options while the child is stopped: the filter can
+  // only be installed afterwards, since it needs PTRACE_O_TRACESECCOMP.
+  raise(SIGSTOP);
+  if (seccomp) {
+    try {
+      InstallSeccompFilter();
+    } catch (std::exception &ex) {
+      std::cerr << "[Error] " << ex.what() << std::endl;
+      _exit(EXIT_FAILURE);
+    }
+  }
+
+  execvp(argv[0], argv);
+  std::cerr << "[Error] Cannot run " << argv[0] << ": " << strerror(errno) << std::endl;
+  _exit(EXIT_FAILURE);
+}
+
+// -----------------------------------------------------------------------------
+static void Resume(pid_t pid, __ptrace_request request, int sig)
+{
+  // Tracees killed by a signal vanish before they can be resumed.
+  if (ptrace(request, pid, nullptr, sig) < 0 && errno != ESRCH) {
+    throw Error("Cannot resume " + std::to_string(pid));
+  }
+}
+
+// -----------------------------------------------------------------------------
+static unsigned long GetEventMsg(pid_t pid)
+{
+  unsigned long msg;
+  if (ptrace(PTRACE_GETEVENTMSG, pid, nullptr, &msg) < 0) {
+    throw Error("Cannot read event of " + std::to_string(pid));
+  }
+  return msg;
+}
+
+// -----------------------------------------------------------------------------
+static std::string GetImage(pid_t pid)
+{
+  const std::string exe = "/proc/" + std::to_string(pid) + "/exe";
+  char buffer[PATH_MAX];
+  const ssize_t n = readlink(exe.c_str(), buffer, sizeof(buffer));
+  if (n < 0) {
+    throw Error("Cannot read " + exe);
+  }
+  return std::string(buffer, n);
+}
+
+// -----------------------------------------------------------------------------
+static std::string GetCwd(pid_t pid)
+{
+  const std::string cwd = "/proc/" + std::to_string(pid) + "/cwd";
+  char buffer[PATH_MAX];
+  const ssize_t n = readlink(cwd.c_str(), buffer, sizeof(buffer));
+  if (n < 0) {
+    throw Error("Cannot read " + cwd);
+  }
+  return std::string(buffer, n);
+}
+
+// -----------------------------------------------------------------------------
+static int RunTracer(Trace *trace, pid_t root, bool seccomp)
+{
+  int status;
+  if (WaitTracee(root, &status, __WALL) < 0) {
+    throw Error("Cannot wait for child");
+  }
+  if (!WIFSTOPPED(status)) {
+    throw std::runtime_error("Child did not stop");
+  }
+
+  // Under seccomp, tracees only stop on the syscalls with handlers. Since
+  // Linux 4.8, the seccomp stop follows the point of the syscall-entry stop,
+  // so resuming it with PTRACE_SYSCALL stops next at the exit. Older kernels
+  // stop at the entry instead: UseSeccomp refuses to run on them.
+  long options =
+      PTRACE_O_TRACESYSGOOD |
+      PTRACE_O_TRACECLONE |
+      PTRACE_O_TRACEFORK |
+      PTRACE_O_TRACEVFORK |
+      PTRACE_O_TRACEEXEC |
+      PTRACE_O_EXITKILL;
+  if (seccomp) {
+    options |= PTRACE_O_TRACESECCOMP;
+  }
+  if (ptrace(PTRACE_SETOPTIONS, root, nullptr, options) < 0) {
+    throw Error("Cannot set options");
+  }
+  const __ptrace_request resume = seccomp ? PTRACE_CONT : PTRACE_SYSCALL;
+
+  // The root is registered by its first exec.
+  std::unordered_map<pid_t, Tracee> tracees;
+  tracees[root];
+  Resume(root, resume, 0);
+
+  // Children which stopped before their parent reported them.
+  std::unordered_set<pid_t> orphans;
+
+  Metrics *metrics = GetMetrics();
+
+  int code = EXIT_FAILURE;
+  while (!tracees.empty()) {
+    const pid_t pid = WaitTracee(-1, &status, __WALL);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == ECHILD) {
+        break;
+      }
+      throw Error("Cannot wait for tracees");
+    }
+
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      if (pid == root) {
+        code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+      }
+      tracees.erase(pid);
+      trace->EndTrace(pid);
+      continue;
+    }
+    if (!WIFSTOPPED(status)) {
+      continue;
+    }
+
+    auto it = tracees.find(pid);
+    if (it == tracees.end()) {
+      orphans.insert(pid);
+      continue;
+    }
+
+    int sig = 0;
+    const int stop = WSTOPSIG(status);
+    const int event = status >> 16;
+    Metrics::Stop kind = Metrics::Stop::kSignal;
+    if (stop == (SIGTRAP | 0x80)) {
+      // Under seccomp, the entry was seen at the seccomp stop.
+      if (seccomp || it->second.InSyscall) {
+        kind = Metrics::Stop::kSyscallExit;
+        it->second.InSyscall = false;
+        if (trace->GetTrace(pid)) {
+          const int64_t sno = CaptureExit(trace, pid);
+          if (metrics) {
+            // The exit and the entry or seccomp stop before it.
+            metrics->AddSyscallStops(sno, 2);
+          }
+        }
+      } else {
+        kind = Metrics::Stop::kSyscallEntry;
+        it->second.InSyscall = true;
+      }
+    } else if (stop == SIGTRAP && event != 0) {
+      kind = Metrics::Stop::kEvent;
+      switch (event) {
+        case PTRACE_EVENT_SECCOMP: {
+          kind = Metrics::Stop::kSeccomp;
+          it->second.InSyscall = true;
+          if (trace->GetTrace(pid)) {
+            CaptureEntry(pid);
+          }
+          break;
+        }
+        case PTRACE_EVENT_FORK:
+        case PTRACE_EVENT_VFORK:
+        case PTRACE_EVENT_CLONE: {
+          const pid_t child = GetEventMsg(pid);
+          trace->SpawnTrace(pid, child, CaptureCloneFlags(pid));
+          if (orphans.erase(child)) {
+            tracees[child];
+            Resume(child, resume, 0);
+          } else {
+            tracees[child].Starting = true;
+          }
+          break;
+        }
+        case PTRACE_EVENT_EXEC: {
+          // A thread which execs takes over the PID of the leader.
+          const pid_t former = GetEventMsg(pid);
+          if (former != pid) {
+            const Tracee thread = tracees[former];
+            tracees.erase(former);
+            tracees[pid] = thread;
+            trace->EndTrace(former);
+          }
+          // Processes which exec keep the directory the trace knows.
+          const std::string cwd = trace->GetTrace(pid) ? "" : GetCwd(pid);
+          trace->StartTrace(pid, GetImage(pid), cwd);
+          break;
+        }
+        default: {
+          break;
+        }
+      }
+    } else if (stop == SIGSTOP && it->second.Starting) {
+      it->second.Starting = false;
+    } else {
+      sig = stop;
+    }
+    if (metrics) {
+      metrics->AddStop(pid, kind);
+    }
+
+    // Under seccomp, the exit of a syscall is only observed if the tracee
+    // is resumed with PTRACE_SYSCALL from its seccomp stop.
+    Resume(pid, tracees[pid].InSyscall ? PTRACE_SYSCALL : resume, sig);
+  }
+  return code;
+}
+
+// -----------------------------------------------------------------------------
+static void Usage(const char *name)
+{
+  std::cerr << "Usage: " << name << " --output=<graph> -- <command> [args...]" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  static const struct option kOptions[] =
+  {
+    { "output", required_argument, nullptr, 'o' },
+    { nullptr, 0, nullptr, 0 },
+  };
+
+  std::string output;
+  for (int c; (c = getopt_long(argc, argv, "o:", kOptions, nullptr)) != -1; ) {
+    switch (c) {
+      case 'o': {
+        output = optarg;
+        break;
+      }
+      default: {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  if (output.empty() || optind >= argc) {
+    Usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Trace trace(output);
+
+    const bool seccomp = UseSeccomp();
+    const pid_t pid = fork();
+    if (pid < 0) {
+      throw Error("Cannot fork");
+    }
+    if (pid == 0) {
+      RunChild(argv + optind, seccomp);
+    }
+    return RunTracer(&trace, pid, seccomp);
+  } catch (std::exception &ex) {
+    std::cerr << "[Error] " << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
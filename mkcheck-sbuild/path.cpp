@@ -0,0 +1,201 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "path.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "metrics.h"
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kMaxResolved = 1 << 20;
+
+// -----------------------------------------------------------------------------
+static constexpr PathID kAbsolute = UINT32_MAX;
+
+// -----------------------------------------------------------------------------
+bool PathTable::Key::operator == (const Key &that) const
+{
+  return Length == that.Length && memcmp(Data, that.Data, Length) == 0;
+}
+
+// -----------------------------------------------------------------------------
+size_t PathTable::KeyHash::operator() (const Key &key) const
+{
+  // FNV-1a over 8-byte words, with the tail folded into the last word.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  const char *ptr = key.Data;
+  size_t len = key.Length;
+  while (len >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ull;
+    ptr += sizeof(word);
+    len -= sizeof(word);
+  }
+  uint64_t tail = key.Length;
+  memcpy(&tail, ptr, len);
+  hash = (hash ^ tail) * 0x100000001b3ull;
+  return hash ^ (hash >> 29);
+}
+
+// -----------------------------------------------------------------------------
+PathID PathTable::Intern(const char *str, size_t len)
+{
+  auto it = ids_.find(Key{ str, len });
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  // UINT32_MAX is reserved for the bucket of absolute paths.
+  if (paths_.size() >= UINT32_MAX) {
+    throw std::runtime_error("Too many paths");
+  }
+
+  const PathID id = paths_.size();
+  paths_.emplace_back(str, len);
+  const std::string &path = paths_.back();
+  ids_.emplace(Key{ path.data(), path.size() }, id);
+  return id;
+}
+
+// -----------------------------------------------------------------------------
+PathTable &GetPathTable()
+{
+  // Never freed: the table is used by exit handlers.
+  static PathTable *table = new PathTable();
+  return *table;
+}
+
+// -----------------------------------------------------------------------------
+PathID ParentPath(PathID id)
+{
+  PathTable &table = GetPathTable();
+  const std::string &path = table.Get(id);
+  const size_t sep = path.rfind('/');
+  if (sep == 0 || sep == std::string::npos) {
+    return table.Intern("/", 1);
+  }
+  return table.Intern(path.data(), sep);
+}
+
+// -----------------------------------------------------------------------------
+static const char *FindSeparator(const char *ptr, const char *end)
+{
+#ifdef __SSE2__
+  const __m128i slash = _mm_set1_epi8('/');
+  while (end - ptr >= 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, slash));
+    if (mask) {
+      return ptr + __builtin_ctz(mask);
+    }
+    ptr += 16;
+  }
+#endif
+  const void *sep = memchr(ptr, '/', end - ptr);
+  return sep ? static_cast<const char *>(sep) : end;
+}
+
+// -----------------------------------------------------------------------------
+static void Append(std::string &buf, const char *ptr, size_t len)
+{
+  // The buffer holds the resolved prefix as a sequence of "/name" entries,
+  // with the root being the empty string.
+  const char *end = ptr + len;
+  while (ptr < end) {
+    const char *sep = FindSeparator(ptr, end);
+    const size_t n = sep - ptr;
+    if (n == 0 || (n == 1 && ptr[0] == '.')) {
+      // Empty component or '.'.
+    } else if (n == 2 && ptr[0] == '.' && ptr[1] == '.') {
+      const size_t last = buf.rfind('/');
+      buf.resize(last == std::string::npos ? 0 : last);
+    } else {
+      buf.push_back('/');
+      buf.append(ptr, n);
+    }
+    ptr = sep + 1;
+  }
+}
+
+// -----------------------------------------------------------------------------
+PathID NormalisePath(const std::string &base, const char *path, size_t len)
+{
+  static std::string buf;
+
+  Metrics *metrics = GetMetrics();
+  const uint64_t start = metrics ? GetTime() : 0;
+
+  buf.clear();
+  if (len == 0 || path[0] != '/') {
+    Append(buf, base.data(), base.size());
+  }
+  Append(buf, path, len);
+  if (buf.empty()) {
+    buf.push_back('/');
+  }
+  const PathID id = GetPathTable().Intern(buf);
+
+  if (metrics) {
+    metrics->AddNormaliseTime(GetTime() - start);
+  }
+  return id;
+}
+
+// -----------------------------------------------------------------------------
+PathID ResolveCache::Resolve(PathID base, const char *path, size_t len)
+{
+  const bool absolute = len != 0 && path[0] == '/';
+  auto it = buckets_.find(absolute ? kAbsolute : base);
+  if (it == buckets_.end()) {
+    it = buckets_.emplace(absolute ? kAbsolute : base, Bucket()).first;
+  }
+  Bucket &bucket = it->second;
+
+  key_.assign(path, len);
+  auto entry = bucket.find(key_);
+  if (entry != bucket.end()) {
+    ++hits_;
+    return entry->second;
+  }
+  ++misses_;
+
+  static const std::string root;
+  const PathID id = NormalisePath(absolute ? root : GetPathTable().Get(base), path, len);
+  if (size_ >= kMaxResolved) {
+    // Start over rather than tracking the age of entries.
+    for (auto &b : buckets_) {
+      b.second.clear();
+    }
+    size_ = 0;
+  }
+  bucket.emplace(key_, id);
+  ++size_;
+  return id;
+}
+
+// -----------------------------------------------------------------------------
+bool ResolveCache::GetCwd(uint64_t uid, PathID *cwd) const
+{
+  auto it = cwds_.find(uid);
+  if (it == cwds_.end()) {
+    return false;
+  }
+  *cwd = it->second;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+ResolveCache &GetResolveCache()
+{
+  static ResolveCache cache;
+  return cache;
+}
@@ -0,0 +1,146 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+
+
+/// Dense identifier of an interned, canonical path.
+typedef uint32_t PathID;
+
+/**
+ * Table mapping canonical paths to dense 32-bit identifiers.
+ *
+ * Each unique path is copied once; lookups of known paths do not allocate.
+ */
+class PathTable final {
+public:
+  /// Returns the ID of a path, interning it if it was not seen before.
+  PathID Intern(const char *str, size_t len);
+
+  /// Returns the ID of a path, interning it if it was not seen before.
+  PathID Intern(const std::string &str)
+  {
+    return Intern(str.data(), str.size());
+  }
+
+  /// Returns the path with a given ID.
+  const std::string &Get(PathID id) const
+  {
+    return paths_[id];
+  }
+
+  /// Returns the number of interned paths.
+  size_t Size() const
+  {
+    return paths_.size();
+  }
+
+private:
+  /// View of an interned string.
+  struct Key {
+    const char *Data;
+    size_t Length;
+
+    bool operator == (const Key &that) const;
+  };
+
+  /// Hash of a string view.
+  struct KeyHash {
+    size_t operator() (const Key &key) const;
+  };
+
+private:
+  /// Stable storage for the interned strings.
+  std::deque<std::string> paths_;
+  /// Mapping from views into paths_ to their IDs.
+  std::unordered_map<Key, PathID, KeyHash> ids_;
+};
+
+/**
+ * Returns the table shared by all handlers.
+ */
+PathTable &GetPathTable();
+
+/**
+ * Returns the ID of the directory containing a path.
+ */
+PathID ParentPath(PathID id);
+
+/**
+ * Resolves a path against a base directory and interns it.
+ *
+ * `.`, `..` and repeated separators are resolved lexically, in place, in a
+ * reusable buffer; relative paths are appended to the base. The base is
+ * ignored if the path is absolute.
+ */
+PathID NormalisePath(const std::string &base, const char *path, size_t len);
+
+/**
+ * Resolves a path against a base directory and interns it.
+ */
+inline PathID NormalisePath(const std::string &base, const std::string &path)
+{
+  return NormalisePath(base, path.data(), path.size());
+}
+
+/**
+ * Cache of resolved paths, keyed by the base directory and the path.
+ *
+ * Relative paths are keyed by the ID of the directory they are resolved
+ * against, the cwd or the target of a dirfd, and absolute paths share a
+ * single bucket. Resolution is lexical only, as in NormalisePath: symlinks
+ * are not followed, so an entry depends on nothing but its key and never
+ * has to be invalidated, even if the file system changes. The cwd of each
+ * process is kept as an ID, replaced on chdir.
+ */
+class ResolveCache final {
+public:
+  /// Resolves a path against a base directory.
+  PathID Resolve(PathID base, const char *path, size_t len);
+  /// Resolves a path against a base directory.
+  PathID Resolve(PathID base, const std::string &path)
+  {
+    return Resolve(base, path.data(), path.size());
+  }
+
+  /// Records the cwd of a process.
+  void SetCwd(uint64_t uid, PathID cwd) { cwds_[uid] = cwd; }
+  /// Finds the cwd of a process, if it is known.
+  bool GetCwd(uint64_t uid, PathID *cwd) const;
+  /// Drops the cwd of a process which exited.
+  void DropCwd(uint64_t uid) { cwds_.erase(uid); }
+
+  /// Returns the number of lookups served from the cache.
+  uint64_t GetHits() const { return hits_; }
+  /// Returns the number of lookups which had to resolve the path.
+  uint64_t GetMisses() const { return misses_; }
+
+private:
+  /// Resolved paths, by path.
+  using Bucket = std::unordered_map<std::string, PathID>;
+
+private:
+  /// Buckets, by base directory.
+  std::unordered_map<PathID, Bucket> buckets_;
+  /// Cwd of each process.
+  std::unordered_map<uint64_t, PathID> cwds_;
+  /// Buffer for the keys of lookups.
+  std::string key_;
+  /// Number of entries in all buckets.
+  size_t size_ = 0;
+  /// Statistics.
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+/**
+ * Returns the cache shared by all handlers.
+ */
+ResolveCache &GetResolveCache();
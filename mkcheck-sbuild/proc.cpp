@@ -0,0 +1,15 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "proc.h"
+
+
+
+// -----------------------------------------------------------------------------
+Process::Process(pid_t pid, uint64_t uid, uint64_t parent, PathID image)
+  : pid_(pid)
+  , uid_(uid)
+  , parent_(parent)
+  , image_(image)
+{
+}
@@ -0,0 +1,47 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "path.h"
+
+
+
+/**
+ * Process traced by the tracer.
+ *
+ * Only the identity of the process is kept here: its descriptors are in
+ * the fd tables (see fdtable.h), its cwd in the resolve cache (see path.h)
+ * and the files it accessed in the records (see records.h), all keyed by
+ * the UID, which is never reused, unlike the PID.
+ */
+class Process final {
+public:
+  Process(pid_t pid, uint64_t uid, uint64_t parent, PathID image);
+
+  /// Returns the PID of the process.
+  pid_t GetPID() const { return pid_; }
+  /// Returns the unique ID of the process.
+  uint64_t GetUID() const { return uid_; }
+  /// Returns the UID of the parent, 0 for the root.
+  uint64_t GetParent() const { return parent_; }
+  /// Returns the image the process is running.
+  PathID GetImage() const { return image_; }
+
+  /// Replaces the image, on exec.
+  void SetImage(PathID image) { image_ = image; }
+
+private:
+  /// PID of the process.
+  const pid_t pid_;
+  /// Unique ID of the process.
+  const uint64_t uid_;
+  /// UID of the parent.
+  const uint64_t parent_;
+  /// Image being run.
+  PathID image_;
+};
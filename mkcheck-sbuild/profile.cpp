@@ -0,0 +1,397 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "json.h"
+#include "metrics.h"
+
+
+
+// -----------------------------------------------------------------------------
+static uint64_t ToNs(const timeval &tv)
+{
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000000ull + tv.tv_usec * 1000ull;
+}
+
+
+
+// -----------------------------------------------------------------------------
+Profiler::Profiler(const std::string &path)
+  : path_(path)
+  , start_(GetTime())
+{
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::Start(uint64_t uid, pid_t pid)
+{
+  Add(uid, pid, -1);
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::Spawn(uint64_t parent, uint64_t uid, pid_t pid)
+{
+  auto it = uids_.find(parent);
+  if (it == uids_.end()) {
+    Add(uid, pid, -1);
+    return;
+  }
+
+  const size_t index = it->second;
+  Add(uid, pid, index);
+  procs_[index].HasChildren = true;
+
+  // Images are replaced on exec only.
+  Proc &proc = procs_.back();
+  proc.HasImage = procs_[index].HasImage;
+  proc.Image = procs_[index].Image;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::End(uint64_t uid)
+{
+  auto it = uids_.find(uid);
+  if (it == uids_.end()) {
+    return;
+  }
+  procs_[it->second].End = GetTime();
+  uids_.erase(it);
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::SetUsage(pid_t pid, const struct rusage &usage)
+{
+  auto it = pids_.find(pid);
+  if (it == pids_.end()) {
+    return;
+  }
+  Proc &proc = procs_[it->second];
+  proc.HasUsage = true;
+  proc.CpuNs = ToNs(usage.ru_utime) + ToNs(usage.ru_stime);
+  pids_.erase(it);
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::SetImage(uint64_t uid, PathID image)
+{
+  if (Proc *proc = Find(uid)) {
+    proc->HasImage = true;
+    proc->Image = image;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::SetTask(pid_t pid, const std::string &task)
+{
+  auto it = pids_.find(pid);
+  if (it == pids_.end()) {
+    return;
+  }
+
+  auto id = taskIDs_.emplace(task, tasks_.size());
+  if (id.second) {
+    tasks_.emplace_back();
+    tasks_.back().Name = task;
+    tasks_.back().Start = GetTime();
+  }
+  procs_[it->second].Task = id.first->second + 1;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::AddTask(const std::string &task, uint64_t start, uint64_t end)
+{
+  auto it = taskIDs_.find(task);
+  if (it == taskIDs_.end()) {
+    return;
+  }
+  Task &t = tasks_[it->second];
+  t.WallNs += end - start;
+  t.Runs += 1;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::AddInput(uint64_t uid, PathID path)
+{
+  auto writer = writers_.find(path);
+  if (writer == writers_.end()) {
+    return;
+  }
+  auto it = uids_.find(uid);
+  if (it == uids_.end() || it->second == writer->second) {
+    return;
+  }
+
+  std::vector<uint64_t> &deps = procs_[it->second].Deps;
+  if (std::find(deps.begin(), deps.end(), writer->second) == deps.end()) {
+    deps.push_back(writer->second);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::AddOutput(uint64_t uid, PathID path)
+{
+  auto it = uids_.find(uid);
+  if (it != uids_.end()) {
+    writers_[path] = it->second;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::Rename(PathID from, PathID to)
+{
+  auto it = writers_.find(from);
+  if (it == writers_.end()) {
+    writers_.erase(to);
+    return;
+  }
+  const size_t writer = it->second;
+  writers_.erase(it);
+  writers_[to] = writer;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::AddRead(uint64_t uid, PathID path, uint64_t bytes)
+{
+  files_[path].BytesRead += bytes;
+  if (Proc *proc = Find(uid)) {
+    proc->BytesRead += bytes;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::AddWrite(uint64_t uid, PathID path, uint64_t bytes)
+{
+  files_[path].BytesWritten += bytes;
+  if (Proc *proc = Find(uid)) {
+    proc->BytesWritten += bytes;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::Add(uint64_t uid, pid_t pid, int64_t parent)
+{
+  Proc proc;
+  proc.UID = uid;
+  proc.Parent = parent;
+  proc.Task = 0;
+  proc.Start = GetTime();
+  uids_[uid] = procs_.size();
+  pids_[pid] = procs_.size();
+  procs_.push_back(std::move(proc));
+}
+
+// -----------------------------------------------------------------------------
+Profiler::Proc *Profiler::Find(uint64_t uid)
+{
+  auto it = uids_.find(uid);
+  return it == uids_.end() ? nullptr : &procs_[it->second];
+}
+
+// -----------------------------------------------------------------------------
+Profiler::Path Profiler::Critical(
+    const std::vector<uint64_t> &weights,
+    const std::vector<std::vector<size_t>> &deps)
+{
+  // Dependencies on nodes which started later close cycles: they are cut.
+  std::vector<uint64_t> length(weights.size());
+  std::vector<int64_t> prev(weights.size(), -1);
+  int64_t last = -1;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    uint64_t longest = 0;
+    for (size_t dep : deps[i]) {
+      if (dep < i && (prev[i] < 0 || length[dep] > longest)) {
+        longest = length[dep];
+        prev[i] = dep;
+      }
+    }
+    length[i] = longest + weights[i];
+    if (last < 0 || length[i] > length[last]) {
+      last = i;
+    }
+  }
+
+  Path path{ last < 0 ? 0 : length[last], {} };
+  for (int64_t i = last; i >= 0; i = prev[i]) {
+    path.Nodes.push_back(i);
+  }
+  std::reverse(path.Nodes.begin(), path.Nodes.end());
+  return path;
+}
+
+// -----------------------------------------------------------------------------
+void Profiler::Dump() const
+{
+  const uint64_t now = GetTime();
+  auto wall = [now] (const Proc &proc) {
+    return (proc.End ? proc.End : now) - proc.Start;
+  };
+
+  // Children reaped by their parent are included in its usage.
+  std::vector<uint64_t> childCpu(procs_.size());
+  for (const Proc &proc : procs_) {
+    if (proc.Parent >= 0 && proc.HasUsage && proc.End) {
+      const Proc &parent = procs_[proc.Parent];
+      if (!parent.End || proc.End <= parent.End) {
+        childCpu[proc.Parent] += proc.CpuNs;
+      }
+    }
+  }
+  std::vector<uint64_t> selfCpu(procs_.size());
+  for (size_t i = 0; i < procs_.size(); ++i) {
+    const uint64_t cpu = procs_[i].CpuNs;
+    selfCpu[i] = cpu > childCpu[i] ? cpu - childCpu[i] : 0;
+  }
+
+  // Tasks are charged with the processes which ran them.
+  std::vector<uint64_t> taskCpu(tasks_.size());
+  std::vector<uint64_t> taskRead(tasks_.size());
+  std::vector<uint64_t> taskWritten(tasks_.size());
+  std::vector<uint64_t> taskProcs(tasks_.size());
+  std::vector<std::vector<size_t>> taskDeps(tasks_.size());
+  for (size_t i = 0; i < procs_.size(); ++i) {
+    const Proc &proc = procs_[i];
+    if (!proc.Task) {
+      continue;
+    }
+    const size_t task = proc.Task - 1;
+    taskCpu[task] += selfCpu[i];
+    taskRead[task] += proc.BytesRead;
+    taskWritten[task] += proc.BytesWritten;
+    taskProcs[task] += 1;
+    for (size_t dep : proc.Deps) {
+      const uint32_t from = procs_[dep].Task;
+      if (from && from - 1 != task) {
+        taskDeps[task].push_back(from - 1);
+      }
+    }
+  }
+
+  std::vector<uint64_t> procWeights(procs_.size());
+  std::vector<std::vector<size_t>> procDeps(procs_.size());
+  for (size_t i = 0; i < procs_.size(); ++i) {
+    procWeights[i] = procs_[i].HasChildren ? 0 : wall(procs_[i]);
+    procDeps[i].assign(procs_[i].Deps.begin(), procs_[i].Deps.end());
+  }
+  std::vector<uint64_t> taskWeights(tasks_.size());
+  for (size_t i = 0; i < tasks_.size(); ++i) {
+    taskWeights[i] = tasks_[i].WallNs;
+  }
+  const Path procPath = Critical(procWeights, procDeps);
+  const Path taskPath = Critical(taskWeights, taskDeps);
+
+  const PathTable &table = GetPathTable();
+  const std::string tmp = path_ + ".tmp";
+  {
+    std::ofstream os(tmp);
+
+    os << "{" << std::endl;
+    os << "  \"elapsed_ns\": " << now - start_ << "," << std::endl;
+
+    os << "  \"procs\": [" << std::endl;
+    for (size_t i = 0; i < procs_.size(); ++i) {
+      const Proc &proc = procs_[i];
+      os << (i ? ",\n" : "");
+      os << "    { \"uid\": " << proc.UID
+         << ", \"parent\": ";
+      if (proc.Parent >= 0) {
+        os << procs_[proc.Parent].UID;
+      } else {
+        os << "null";
+      }
+      os << ", \"image\": ";
+      if (proc.HasImage) {
+        os << "\"" << EscapeJson(table.Get(proc.Image)) << "\"";
+      } else {
+        os << "null";
+      }
+      os << ", \"task\": ";
+      if (proc.Task) {
+        os << "\"" << EscapeJson(tasks_[proc.Task - 1].Name) << "\"";
+      } else {
+        os << "null";
+      }
+      os << ", \"start_ns\": " << proc.Start - start_
+         << ", \"wall_ns\": " << wall(proc)
+         << ", \"cpu_ns\": " << proc.CpuNs
+         << ", \"self_cpu_ns\": " << selfCpu[i]
+         << ", \"bytes_read\": " << proc.BytesRead
+         << ", \"bytes_written\": " << proc.BytesWritten
+         << " }";
+    }
+    os << std::endl << "  ]," << std::endl;
+
+    os << "  \"tasks\": [" << std::endl;
+    for (size_t i = 0; i < tasks_.size(); ++i) {
+      const Task &task = tasks_[i];
+      os << (i ? ",\n" : "");
+      os << "    { \"name\": \"" << EscapeJson(task.Name) << "\""
+         << ", \"start_ns\": " << task.Start - start_
+         << ", \"wall_ns\": " << task.WallNs
+         << ", \"runs\": " << task.Runs
+         << ", \"procs\": " << taskProcs[i]
+         << ", \"cpu_ns\": " << taskCpu[i]
+         << ", \"bytes_read\": " << taskRead[i]
+         << ", \"bytes_written\": " << taskWritten[i]
+         << " }";
+    }
+    os << std::endl << "  ]," << std::endl;
+
+    os << "  \"files\": [" << std::endl;
+    bool first = true;
+    for (const auto &it : files_) {
+      os << (first ? "" : ",\n");
+      os << "    { \"name\": \"" << EscapeJson(table.Get(it.first)) << "\""
+         << ", \"bytes_read\": " << it.second.BytesRead
+         << ", \"bytes_written\": " << it.second.BytesWritten
+         << " }";
+      first = false;
+    }
+    os << std::endl << "  ]," << std::endl;
+
+    os << "  \"critical_path\": {" << std::endl;
+    os << "    \"procs_ns\": " << procPath.Length << "," << std::endl;
+    os << "    \"procs\": [";
+    for (size_t i = 0; i < procPath.Nodes.size(); ++i) {
+      os << (i ? ", " : "") << procs_[procPath.Nodes[i]].UID;
+    }
+    os << "]," << std::endl;
+    os << "    \"tasks_ns\": " << taskPath.Length << "," << std::endl;
+    os << "    \"tasks\": [";
+    for (size_t i = 0; i < taskPath.Nodes.size(); ++i) {
+      os << (i ? ", " : "") << "\"" << EscapeJson(tasks_[taskPath.Nodes[i]].Name) << "\"";
+    }
+    os << "]" << std::endl;
+    os << "  }" << std::endl;
+    os << "}" << std::endl;
+  }
+  rename(tmp.c_str(), path_.c_str());
+}
+
+// -----------------------------------------------------------------------------
+static void DumpProfile()
+{
+  GetProfiler()->Dump();
+}
+
+// -----------------------------------------------------------------------------
+Profiler *GetProfiler()
+{
+  static Profiler *profiler = [] () -> Profiler * {
+    const char *path = getenv("MKCHECK_PROFILE");
+    if (!path || !*path) {
+      return nullptr;
+    }
+
+    // Never freed: the report is written by an exit handler.
+    Profiler *p = new Profiler(path);
+    atexit(DumpProfile);
+    return p;
+  }();
+  return profiler;
+}
@@ -0,0 +1,142 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "path.h"
+
+
+
+/**
+ * Profile of the traced build: time and I/O of processes, tasks and files.
+ *
+ * Enabled by setting MKCHECK_PROFILE to the path of the report, which is
+ * written as JSON when the tracer exits. Processes are timed from spawn to
+ * exit; their CPU time is the usage reported when they are reaped, which
+ * includes the children they reaped themselves. Tasks (see tasks.h) are
+ * timed from marker to marker and charged with the processes which ran
+ * them.
+ *
+ * A process depends on the last writer of every file it reads. The report
+ * ends with the critical path through these dependencies: the chain of
+ * processes, or of tasks if markers are available, with the largest total
+ * duration. Processes which spawn others only wait for them, so they do
+ * not add to the length of the process path.
+ */
+class Profiler final {
+public:
+  Profiler(const std::string &path);
+
+  /// The root process started.
+  void Start(uint64_t uid, pid_t pid);
+  /// A process was created by a traced one.
+  void Spawn(uint64_t parent, uint64_t uid, pid_t pid);
+  /// A process exited.
+  void End(uint64_t uid);
+  /// A process was reaped.
+  void SetUsage(pid_t pid, const struct rusage &usage);
+  /// Records the image run by a process.
+  void SetImage(uint64_t uid, PathID image);
+
+  /// A process started running a task.
+  void SetTask(pid_t pid, const std::string &task);
+  /// A task ended.
+  void AddTask(const std::string &task, uint64_t start, uint64_t end);
+
+  /// A process read a file, depending on its last writer.
+  void AddInput(uint64_t uid, PathID path);
+  /// A process wrote to a file.
+  void AddOutput(uint64_t uid, PathID path);
+  /// A file was renamed, keeping its writer.
+  void Rename(PathID from, PathID to);
+  /// Bytes were read from a file.
+  void AddRead(uint64_t uid, PathID path, uint64_t bytes);
+  /// Bytes were written to a file.
+  void AddWrite(uint64_t uid, PathID path, uint64_t bytes);
+
+  /// Writes the report.
+  void Dump() const;
+
+private:
+  /// Profile of a process.
+  struct Proc {
+    uint64_t UID;
+    /// Index of the parent, or -1.
+    int64_t Parent;
+    /// Index of the task + 1, or 0.
+    uint32_t Task;
+    bool HasImage = false;
+    bool HasUsage = false;
+    bool HasChildren = false;
+    PathID Image = 0;
+    uint64_t Start;
+    uint64_t End = 0;
+    uint64_t CpuNs = 0;
+    uint64_t BytesRead = 0;
+    uint64_t BytesWritten = 0;
+    /// Indices of the processes it depends on.
+    std::vector<uint64_t> Deps;
+  };
+
+  /// Profile of a task.
+  struct Task {
+    std::string Name;
+    uint64_t Start = 0;
+    uint64_t WallNs = 0;
+    uint64_t Runs = 0;
+  };
+
+  /// I/O on a file.
+  struct File {
+    uint64_t BytesRead = 0;
+    uint64_t BytesWritten = 0;
+  };
+
+  /// Longest chain of nodes.
+  struct Path {
+    uint64_t Length;
+    std::vector<size_t> Nodes;
+  };
+
+  /// Adds a process.
+  void Add(uint64_t uid, pid_t pid, int64_t parent);
+  /// Finds a process by UID.
+  Proc *Find(uint64_t uid);
+  /// Finds the longest path, given nodes in topological order.
+  static Path Critical(
+      const std::vector<uint64_t> &weights,
+      const std::vector<std::vector<size_t>> &deps);
+
+private:
+  /// Path to the report.
+  const std::string path_;
+  /// Start of the trace.
+  const uint64_t start_;
+  /// Processes, in the order they started.
+  std::vector<Proc> procs_;
+  /// Index of live processes, by UID.
+  std::unordered_map<uint64_t, size_t> uids_;
+  /// Index of the last process with a PID, which may be reaped late.
+  std::unordered_map<pid_t, size_t> pids_;
+  /// Tasks, in the order they ended.
+  std::vector<Task> tasks_;
+  /// Index of tasks, by name.
+  std::unordered_map<std::string, size_t> taskIDs_;
+  /// I/O on files.
+  std::unordered_map<PathID, File> files_;
+  /// Last process which wrote each file.
+  std::unordered_map<PathID, size_t> writers_;
+};
+
+/**
+ * Returns the profiler, or nullptr if MKCHECK_PROFILE is not set.
+ */
+Profiler *GetProfiler();
@@ -0,0 +1,471 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "records.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "filter.h"
+#include "hash.h"
+#include "json.h"
+
+
+
+// -----------------------------------------------------------------------------
+static bool IsExcluded(PathID file)
+{
+  PathFilter *filter = GetPathFilter();
+  return filter && filter->IsExcluded(file);
+}
+
+// -----------------------------------------------------------------------------
+static void DropExcluded(std::vector<PathID> &files)
+{
+  files.erase(std::remove_if(files.begin(), files.end(), IsExcluded), files.end());
+}
+
+
+
+// -----------------------------------------------------------------------------
+ProcessRecords::ProcessRecords(const std::string &path, Format format)
+  : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644))
+  , format_(format)
+{
+  if (fd_ < 0) {
+    throw std::runtime_error(
+        "Cannot open " + path + ": " + std::string(strerror(errno))
+    );
+  }
+  if (format_ == Format::kStream) {
+    buf_ = "{\"format\":\"mkcheck-stream\",\"version\":1}\n";
+    Flush();
+  }
+}
+
+// -----------------------------------------------------------------------------
+ProcessRecords::~ProcessRecords()
+{
+  Close();
+}
+
+// -----------------------------------------------------------------------------
+ProcessRecords::Record &ProcessRecords::Get(uint64_t uid)
+{
+  return live_[uid];
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Spawn(uint64_t uid, uint64_t parent)
+{
+  // Children run the image of their parent until they exec, even if the
+  // parent already exited and was frozen.
+  PathID image = 0;
+  bool hasImage = false;
+  auto it = live_.find(parent);
+  if (it != live_.end()) {
+    image = it->second.Image;
+    hasImage = it->second.HasImage;
+  } else if (const Frozen *proc = Find(parent)) {
+    image = proc->Image;
+    hasImage = proc->HasImage;
+  }
+
+  Record &record = Get(uid);
+  record.Parent = parent;
+  if (!record.HasImage) {
+    record.Image = image;
+    record.HasImage = hasImage;
+    record.COW = parent != 0;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::SetImage(uint64_t uid, PathID image)
+{
+  Record &record = Get(uid);
+  record.Image = image;
+  record.HasImage = true;
+  record.COW = false;
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Insert(std::vector<PathID> &files, PathID file)
+{
+  if (!files.empty() && files.back() == file) {
+    return;
+  }
+  files.push_back(file);
+
+  // Duplicates are removed whenever the capacity is exhausted, so the set
+  // stays within a constant factor of the number of distinct files.
+  if (files.size() == files.capacity()) {
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+  }
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::AddInput(uint64_t uid, PathID file)
+{
+  Insert(Get(uid).Inputs, file);
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::AddOutput(uint64_t uid, PathID file)
+{
+  Insert(Get(uid).Outputs, file);
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::AddTouched(uint64_t uid, PathID file)
+{
+  Insert(Get(uid).Touched, file);
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::AddDependency(PathID file, PathID on)
+{
+  if (format_ == Format::kGraph) {
+    deps_.emplace_back(file, on);
+    return;
+  }
+  EmitFile(file);
+  EmitFile(on);
+  buf_ += "{\"dep\":" + std::to_string(file) + ",\"on\":" + std::to_string(on) + "}\n";
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Remove(PathID file)
+{
+  if (format_ == Format::kGraph) {
+    removed_.push_back(file);
+    return;
+  }
+  EmitFile(file);
+  buf_ += "{\"removed\":" + std::to_string(file) + "}\n";
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::EmitFile(PathID file)
+{
+  if (file >= emitted_.size()) {
+    emitted_.resize(GetPathTable().Size(), false);
+  }
+  if (emitted_[file]) {
+    return;
+  }
+  emitted_[file] = true;
+
+  buf_ += "{\"file\":" + std::to_string(file);
+  buf_ += ",\"name\":\"" + EscapeJson(GetPathTable().Get(file)) + "\"}\n";
+}
+
+// -----------------------------------------------------------------------------
+static std::string FormatHash(uint64_t hash)
+{
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(hash));
+  return buf;
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::EmitHashes()
+{
+  HashPool *pool = GetHashPool();
+  if (!pool) {
+    return;
+  }
+  for (const auto &it : pool->Take()) {
+    EmitFile(it.first);
+    buf_ += "{\"hash\":" + std::to_string(it.first);
+    buf_ += ",\"value\":\"" + FormatHash(it.second) + "\"}\n";
+  }
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::EmitList(const char *key, const PathID *files, size_t n, bool filter)
+{
+  buf_ += ",\"";
+  buf_ += key;
+  buf_ += "\":[";
+  bool first = true;
+  for (size_t i = 0; i < n; ++i) {
+    if (filter && IsExcluded(files[i])) {
+      continue;
+    }
+    if (!first) {
+      buf_ += ',';
+    }
+    first = false;
+    buf_ += std::to_string(files[i]);
+  }
+  buf_ += ']';
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Compact(std::vector<PathID> &files)
+{
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+}
+
+// -----------------------------------------------------------------------------
+ProcessRecords::Frozen ProcessRecords::Freeze(uint64_t uid, Record &record)
+{
+  Compact(record.Inputs);
+  Compact(record.Outputs);
+  Compact(record.Touched);
+
+  // A chunk cannot be amended, so it only keeps the files produced so far.
+  if (format_ == Format::kStream) {
+    DropExcluded(record.Inputs);
+    DropExcluded(record.Touched);
+  }
+
+  Frozen proc;
+  proc.UID = uid;
+  proc.Parent = record.Parent;
+  proc.Image = record.Image;
+  proc.HasImage = record.HasImage;
+  proc.COW = record.COW;
+  proc.NumInputs = record.Inputs.size();
+  proc.NumOutputs = record.Outputs.size();
+  proc.NumTouched = record.Touched.size();
+
+  const size_t n = proc.NumInputs + proc.NumOutputs + proc.NumTouched;
+  PathID *files = n ? static_cast<PathID *>(
+      arena_.Allocate(n * sizeof(PathID), alignof(PathID))
+  ) : nullptr;
+  PathID *ptr = files;
+  ptr = std::copy(record.Inputs.begin(), record.Inputs.end(), ptr);
+  ptr = std::copy(record.Outputs.begin(), record.Outputs.end(), ptr);
+  std::copy(record.Touched.begin(), record.Touched.end(), ptr);
+  proc.Files = files;
+  return proc;
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::EmitChunk(const Frozen &proc)
+{
+  // Names go first, so readers can resolve all IDs of a process.
+  if (proc.HasImage) {
+    EmitFile(proc.Image);
+  }
+  for (size_t i = 0, n = proc.NumInputs + proc.NumOutputs + proc.NumTouched; i < n; ++i) {
+    EmitFile(proc.Files[i]);
+  }
+
+  buf_ += "{\"proc\":" + std::to_string(proc.UID);
+  buf_ += ",\"parent\":" + std::to_string(proc.Parent);
+  if (proc.HasImage) {
+    buf_ += ",\"image\":" + std::to_string(proc.Image);
+  }
+  if (proc.COW) {
+    buf_ += ",\"cow\":true";
+  }
+  EmitList("input", proc.Inputs(), proc.NumInputs);
+  EmitList("output", proc.Outputs(), proc.NumOutputs);
+  EmitList("touched", proc.Touched(), proc.NumTouched);
+  buf_ += "}\n";
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::End(uint64_t uid)
+{
+  auto it = live_.find(uid);
+  if (it == live_.end()) {
+    return;
+  }
+  const Frozen proc = Freeze(uid, it->second);
+  live_.erase(it);
+
+  switch (format_) {
+    case Format::kStream: {
+      EmitChunk(proc);
+      EmitHashes();
+      Flush();
+      arena_.Reset();
+      break;
+    }
+    case Format::kGraph: {
+      index_.emplace(uid, frozen_.size());
+      frozen_.push_back(proc);
+      break;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+const ProcessRecords::Frozen *ProcessRecords::Find(uint64_t uid) const
+{
+  auto it = index_.find(uid);
+  return it == index_.end() ? nullptr : &frozen_[it->second];
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::EmitGraph()
+{
+  const PathTable &table = GetPathTable();
+  HashPool *pool = GetHashPool();
+
+  // Only files referenced by a process or a dependency are written out.
+  // Inputs are filtered now that all the files produced by the build are
+  // known.
+  std::vector<bool> used(table.Size(), false);
+  std::vector<bool> removed(table.Size(), false);
+  for (const Frozen &proc : frozen_) {
+    if (proc.HasImage) {
+      used[proc.Image] = true;
+    }
+    for (size_t i = 0, n = proc.NumInputs + proc.NumOutputs + proc.NumTouched; i < n; ++i) {
+      const PathID file = proc.Files[i];
+      const bool output = i >= proc.NumInputs && i < proc.NumInputs + proc.NumOutputs;
+      if (output || !IsExcluded(file)) {
+        used[file] = true;
+      }
+    }
+  }
+  std::sort(deps_.begin(), deps_.end());
+  deps_.erase(std::unique(deps_.begin(), deps_.end()), deps_.end());
+  for (const auto &dep : deps_) {
+    used[dep.first] = used[dep.second] = true;
+  }
+  for (PathID file : removed_) {
+    removed[file] = true;
+  }
+
+  buf_ += "{\"files\":[";
+  bool first = true;
+  auto dep = deps_.begin();
+  for (PathID id = 0; id < used.size(); ++id) {
+    if (!used[id]) {
+      continue;
+    }
+    const std::string &name = table.Get(id);
+    buf_ += first ? "\n" : ",\n";
+    first = false;
+    buf_ += "{\"id\":" + std::to_string(id);
+    buf_ += ",\"name\":\"" + EscapeJson(name) + "\"";
+    buf_ += access(name.c_str(), F_OK) == 0 ? ",\"exists\":true" : ",\"exists\":false";
+    if (removed[id]) {
+      buf_ += ",\"deleted\":true";
+    }
+    uint64_t hash;
+    if (pool && pool->Find(id, &hash)) {
+      buf_ += ",\"hash\":\"" + FormatHash(hash) + "\"";
+    }
+    buf_ += ",\"deps\":[";
+    for (bool firstDep = true; dep != deps_.end() && dep->first == id; ++dep) {
+      buf_ += firstDep ? "" : ",";
+      buf_ += std::to_string(dep->second);
+      firstDep = false;
+    }
+    buf_ += "]}";
+
+    if (buf_.size() > (1 << 20)) {
+      Flush();
+    }
+  }
+
+  buf_ += "],\"procs\":[";
+  first = true;
+  for (const Frozen &proc : frozen_) {
+    buf_ += first ? "\n" : ",\n";
+    first = false;
+    buf_ += "{\"uid\":" + std::to_string(proc.UID);
+    buf_ += ",\"parent\":" + std::to_string(proc.Parent);
+    if (proc.HasImage) {
+      buf_ += ",\"image\":" + std::to_string(proc.Image);
+    }
+    if (proc.COW) {
+      buf_ += ",\"cow\":true";
+    }
+    EmitList("input", proc.Inputs(), proc.NumInputs, true);
+    EmitList("output", proc.Outputs(), proc.NumOutputs);
+    EmitList("touched", proc.Touched(), proc.NumTouched, true);
+    buf_ += "}";
+
+    if (buf_.size() > (1 << 20)) {
+      Flush();
+    }
+  }
+  buf_ += "]}\n";
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Flush()
+{
+  const char *ptr = buf_.data();
+  size_t len = buf_.size();
+  while (len > 0) {
+    const ssize_t n = write(fd_, ptr, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(
+          "Cannot write records: " + std::string(strerror(errno))
+      );
+    }
+    ptr += n;
+    len -= n;
+  }
+  buf_.clear();
+}
+
+// -----------------------------------------------------------------------------
+void ProcessRecords::Close()
+{
+  if (fd_ < 0) {
+    return;
+  }
+
+  std::vector<uint64_t> uids;
+  for (const auto &it : live_) {
+    uids.push_back(it.first);
+  }
+  std::sort(uids.begin(), uids.end());
+  for (uint64_t uid : uids) {
+    End(uid);
+  }
+  // The fingerprints of the last outputs may still be computed.
+  if (HashPool *pool = GetHashPool()) {
+    pool->Wait();
+  }
+  switch (format_) {
+    case Format::kStream: {
+      EmitHashes();
+      break;
+    }
+    case Format::kGraph: {
+      EmitGraph();
+      break;
+    }
+  }
+  Flush();
+
+  close(fd_);
+  fd_ = -1;
+}
+
+// -----------------------------------------------------------------------------
+static ProcessRecords *records = nullptr;
+
+// -----------------------------------------------------------------------------
+void SetProcessRecords(ProcessRecords *r)
+{
+  records = r;
+}
+
+// -----------------------------------------------------------------------------
+ProcessRecords *GetProcessRecords()
+{
+  return records;
+}
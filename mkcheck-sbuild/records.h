@@ -0,0 +1,178 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "path.h"
+
+
+
+/**
+ * Graph output built from per-process records.
+ *
+ * Files accessed by a process are kept as path IDs while it runs. When it
+ * exits, the record is frozen: the ID sets are sorted, deduplicated and
+ * copied into an arena, and the growable vectors are dropped.
+ *
+ * By default, the whole graph is written from the frozen records when the
+ * trace ends, in the format of the mkcheck output:
+ *
+ *   {"files":[{"id":3,"name":"...","exists":true,"deps":[]}],
+ *    "procs":[{"uid":7,"parent":2,"image":1,"input":[3],"output":[]}]}
+ *
+ * Processes which forked and never exec'd carry "cow":true, as they run a
+ * copy of their parent.
+ *
+ * Setting MKCHECK_STREAM bounds memory by the number of live processes
+ * instead: each frozen record is appended to the output as a chunk of JSON
+ * lines and its arena is recycled. A chunk holds the names of files not
+ * seen before, followed by the process:
+ *
+ *   {"format":"mkcheck-stream","version":1}
+ *   {"file":3,"name":"/usr/include/stdio.h"}
+ *   {"proc":7,"parent":2,"image":1,"input":[3],"output":[],"touched":[]}
+ *   {"dep":5,"on":4}
+ *   {"removed":5}
+ *   {"hash":3,"value":"9a0b1c2d3e4f5061"}
+ *
+ * If MKCHECK_FILTER is set, inputs excluded by its rules (see filter.h) are
+ * left out, unless the build produced them. The graph is filtered when it
+ * is written, with all the files produced during the trace; a chunk only
+ * knows the files produced before its process exited.
+ *
+ * If MKCHECK_HASH is set, files carry the fingerprint of their contents (see
+ * hash.h): as a "hash" field in the graph, or as "hash" lines in the stream,
+ * written as the fingerprints complete. A file may be fingerprinted again
+ * after it is written, so the last line wins.
+ *
+ * Chunks are written with a single append, so a crash loses at most the
+ * processes which were still running.
+ */
+class ProcessRecords final {
+public:
+  /// Output formats.
+  enum class Format {
+    kGraph,
+    kStream,
+  };
+
+  /// Immutable record of a process which exited.
+  struct Frozen {
+    uint64_t UID;
+    uint64_t Parent;
+    PathID Image;
+    bool HasImage;
+    bool COW;
+    uint32_t NumInputs;
+    uint32_t NumOutputs;
+    uint32_t NumTouched;
+    /// Sorted inputs, outputs and touched files, in this order.
+    const PathID *Files;
+
+    const PathID *Inputs() const { return Files; }
+    const PathID *Outputs() const { return Files + NumInputs; }
+    const PathID *Touched() const { return Files + NumInputs + NumOutputs; }
+  };
+
+public:
+  ProcessRecords(const std::string &path, Format format);
+  ~ProcessRecords();
+
+  /// Registers a process and its parent, 0 for the root.
+  void Spawn(uint64_t uid, uint64_t parent);
+  /// Records the image a process is running.
+  void SetImage(uint64_t uid, PathID image);
+  /// Checks if a process is known and still running.
+  bool IsLive(uint64_t uid) const { return live_.count(uid) != 0; }
+
+  /// Records a file read by a process.
+  void AddInput(uint64_t uid, PathID file);
+  /// Records a file written by a process.
+  void AddOutput(uint64_t uid, PathID file);
+  /// Records a file whose metadata was accessed by a process.
+  void AddTouched(uint64_t uid, PathID file);
+
+  /// Records a file derived from another, by a rename or a link.
+  void AddDependency(PathID file, PathID on);
+  /// Records the removal of a file.
+  void Remove(PathID file);
+
+  /// Freezes the record of a process which exited.
+  void End(uint64_t uid);
+  /// Returns the frozen record of a process, if it is retained.
+  const Frozen *Find(uint64_t uid) const;
+  /// Ends the processes still running and writes out the graph.
+  void Close();
+
+private:
+  /// Files accessed by a running process.
+  struct Record {
+    uint64_t Parent = 0;
+    PathID Image = 0;
+    bool HasImage = false;
+    bool COW = false;
+    std::vector<PathID> Inputs;
+    std::vector<PathID> Outputs;
+    std::vector<PathID> Touched;
+  };
+
+  /// Returns the record of a process, creating it if needed.
+  Record &Get(uint64_t uid);
+  /// Adds a file to a set, compacting the set as it doubles.
+  static void Insert(std::vector<PathID> &files, PathID file);
+  /// Writes the name of a file, if it was not written yet.
+  void EmitFile(PathID file);
+  /// Sorts a set and removes the duplicates.
+  static void Compact(std::vector<PathID> &files);
+  /// Copies a record into the arena.
+  Frozen Freeze(uint64_t uid, Record &record);
+  /// Writes a list of files, without the excluded ones if filtering.
+  void EmitList(const char *key, const PathID *files, size_t n, bool filter = false);
+  /// Writes a frozen process as a stream chunk.
+  void EmitChunk(const Frozen &proc);
+  /// Writes the fingerprints computed since the last chunk.
+  void EmitHashes();
+  /// Writes the whole graph.
+  void EmitGraph();
+  /// Appends the buffered chunk to the output.
+  void Flush();
+
+private:
+  /// Output file.
+  int fd_;
+  /// Output format.
+  const Format format_;
+  /// Chunk being built.
+  std::string buf_;
+  /// Files whose names were written, indexed by ID.
+  std::vector<bool> emitted_;
+  /// Records of running processes.
+  std::unordered_map<uint64_t, Record> live_;
+  /// Storage of the frozen ID sets.
+  Arena arena_;
+  /// Records of exited processes, in the order they exited.
+  std::vector<Frozen> frozen_;
+  /// Index of the frozen records by UID.
+  std::unordered_map<uint64_t, size_t> index_;
+  /// Dependencies created by renames and links.
+  std::vector<std::pair<PathID, PathID>> deps_;
+  /// Files removed during the build.
+  std::vector<PathID> removed_;
+};
+
+/**
+ * Registers the records of the trace (see trace.h), or nullptr.
+ */
+void SetProcessRecords(ProcessRecords *records);
+
+/**
+ * Returns the records of the trace, or nullptr if there is no trace.
+ */
+ProcessRecords *GetProcessRecords();
@@ -0,0 +1,54 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "replay.h"
+
+#include <cstring>
+#include <stdexcept>
+
+
+
+// -----------------------------------------------------------------------------
+const Region *ReplayMemory::Find(uint64_t addr, size_t len) const
+{
+  if (event_) {
+    for (const Region &region : event_->Memory) {
+      if (region.Addr <= addr && addr + len <= region.Addr + region.Data.size()) {
+        return &region;
+      }
+    }
+  }
+  throw std::runtime_error("Address not in recording");
+}
+
+// -----------------------------------------------------------------------------
+void ReplayMemory::ReadBuffer(pid_t pid, void *buf, uint64_t addr, size_t len)
+{
+  const Region *region = Find(addr, len);
+  memcpy(buf, region->Data.data() + (addr - region->Addr), len);
+}
+
+// -----------------------------------------------------------------------------
+std::string ReplayMemory::ReadString(pid_t pid, uint64_t addr)
+{
+  const Region *region = Find(addr, 0);
+  const char *data = region->Data.data() + (addr - region->Addr);
+  return std::string(data, strnlen(data, region->Data.size() - (addr - region->Addr)));
+}
+
+// -----------------------------------------------------------------------------
+void Replay(Trace *trace, const std::vector<Event> &events)
+{
+  ReplayMemory memory;
+  SetGuestMemory(&memory);
+  try {
+    for (const Event &event : events) {
+      memory.SetEvent(&event);
+      Handle(trace, event.Sno, event.Call);
+    }
+  } catch (...) {
+    SetGuestMemory(nullptr);
+    throw;
+  }
+  SetGuestMemory(nullptr);
+}
@@ -0,0 +1,55 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "memory.h"
+#include "syscall.h"
+
+class Trace;
+
+
+
+/// Region of tracee memory read by a handler.
+struct Region {
+  uint64_t Addr;
+  std::string Data;
+};
+
+/// Syscall, along with the tracee memory its handler reads.
+struct Event {
+  int64_t Sno;
+  Args Call;
+  std::vector<Region> Memory;
+};
+
+/**
+ * Serves reads from the regions recorded with the current event.
+ */
+class ReplayMemory final : public GuestMemory {
+public:
+  /// Selects the event whose regions are read.
+  void SetEvent(const Event *event) { event_ = event; }
+
+  void ReadBuffer(pid_t pid, void *buf, uint64_t addr, size_t len) override;
+  std::string ReadString(pid_t pid, uint64_t addr) override;
+
+private:
+  /// Finds the region holding a range.
+  const Region *Find(uint64_t addr, size_t len) const;
+
+private:
+  /// Event being replayed.
+  const Event *event_ = nullptr;
+};
+
+/**
+ * Runs the handlers over a stream of events, without any tracees.
+ *
+ * The processes must have been registered with the trace beforehand.
+ */
+void Replay(Trace *trace, const std::vector<Event> &events);
@@ -0,0 +1,231 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace ring;
+
+
+
+// -----------------------------------------------------------------------------
+static size_t Align(size_t len)
+{
+  return (len + 7) & ~static_cast<size_t>(7);
+}
+
+// -----------------------------------------------------------------------------
+static std::runtime_error Error(const std::string &what, const std::string &path)
+{
+  return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+// -----------------------------------------------------------------------------
+static void WriteAll(int fd, const char *data, size_t len)
+{
+  while (len > 0) {
+    const ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("Cannot spill ring: " + std::string(strerror(errno)));
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+
+
+// -----------------------------------------------------------------------------
+RingWriter::RingWriter(
+    const std::string &path,
+    const std::string &doorbell,
+    size_t capacity)
+  : path_(path)
+  , fd_(open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644))
+  , doorbell_(-1)
+  , spill_(-1)
+  , map_(nullptr)
+  , size_(kDataOffset + Align(capacity))
+  , header_(nullptr)
+  , stats_()
+  , data_(nullptr)
+  , spillSize_(0)
+  , pending_{ 0, 0 }
+{
+  if (fd_ < 0) {
+    throw Error("Cannot open", path);
+  }
+  if (ftruncate(fd_, size_) < 0) {
+    throw Error("Cannot resize", path);
+  }
+  void *map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    throw Error("Cannot map", path);
+  }
+  map_ = static_cast<uint8_t *>(map);
+  header_ = reinterpret_cast<Header *>(map_);
+  data_ = map_ + kDataOffset;
+
+  // A full doorbell means that the consumer has wake-ups pending anyway.
+  doorbell_ = open(doorbell.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (doorbell_ < 0) {
+    throw Error("Cannot open", doorbell);
+  }
+
+  header_->Capacity = Align(capacity);
+  __atomic_store_n(&header_->Magic, kMagic, __ATOMIC_RELEASE);
+  Ring();
+}
+
+// -----------------------------------------------------------------------------
+RingWriter::~RingWriter()
+{
+  Close();
+}
+
+// -----------------------------------------------------------------------------
+void RingWriter::Publish(const char *data, size_t len)
+{
+  // Batches larger than a quarter of the ring would keep it full.
+  const size_t chunk = header_->Capacity / 4;
+  while (len > chunk) {
+    Publish(data, chunk);
+    data += chunk;
+    len -= chunk;
+  }
+
+  ++header_->Batches;
+  if (pending_.Length == 0 && Push(kData, data, len)) {
+    Ring();
+    return;
+  }
+
+  ++header_->Full;
+  Spill(data, len);
+  if (PushSpill()) {
+    Ring();
+  }
+}
+
+// -----------------------------------------------------------------------------
+void RingWriter::Close()
+{
+  if (!map_) {
+    return;
+  }
+
+  // The consumer is waited for, unless it went away.
+  while (!PushSpill()) {
+    if (IsAbandoned()) {
+      break;
+    }
+    Ring();
+    poll(nullptr, 0, 1);
+  }
+  __atomic_store_n(&header_->Closed, 1, __ATOMIC_RELEASE);
+  Ring();
+
+  stats_ = *header_;
+  header_ = &stats_;
+  munmap(map_, size_);
+  map_ = nullptr;
+  close(fd_);
+  close(doorbell_);
+  if (spill_ >= 0) {
+    close(spill_);
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool RingWriter::Push(Kind kind, const void *data, size_t len)
+{
+  const uint64_t capacity = header_->Capacity;
+  const uint64_t head = header_->Head;
+  const uint64_t tail = __atomic_load_n(&header_->Tail, __ATOMIC_ACQUIRE);
+
+  const size_t need = sizeof(Message) + Align(len);
+  const size_t pos = head % capacity;
+  const size_t room = capacity - pos;
+  const size_t total = room < need ? room + need : need;
+  if (capacity - (head - tail) < total) {
+    return false;
+  }
+
+  uint64_t next = head;
+  if (room < need) {
+    const Message wrap{ static_cast<uint32_t>(room - sizeof(Message)), kWrap };
+    memcpy(data_ + pos, &wrap, sizeof(wrap));
+    next += room;
+  }
+
+  uint8_t *ptr = data_ + next % capacity;
+  const Message msg{ static_cast<uint32_t>(len), kind };
+  memcpy(ptr, &msg, sizeof(msg));
+  memcpy(ptr + sizeof(msg), data, len);
+  next += need;
+
+  header_->Peak = std::max(header_->Peak, next - tail);
+  __atomic_store_n(&header_->Head, next, __ATOMIC_RELEASE);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+bool RingWriter::PushSpill()
+{
+  if (pending_.Length == 0) {
+    return true;
+  }
+  if (!Push(kSpill, &pending_, sizeof(pending_))) {
+    return false;
+  }
+  pending_ = { spillSize_, 0 };
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+void RingWriter::Spill(const char *data, size_t len)
+{
+  if (spill_ < 0) {
+    const std::string path = path_ + ".spill";
+    spill_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (spill_ < 0) {
+      throw Error("Cannot open", path);
+    }
+  }
+
+  WriteAll(spill_, data, len);
+  if (pending_.Length == 0) {
+    pending_.Offset = spillSize_;
+  }
+  pending_.Length += len;
+  spillSize_ += len;
+  ++header_->SpilledBatches;
+  header_->SpilledBytes += len;
+}
+
+// -----------------------------------------------------------------------------
+void RingWriter::Ring()
+{
+  const char byte = 0;
+  while (write(doorbell_, &byte, 1) < 0 && errno == EINTR) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+bool RingWriter::IsAbandoned() const
+{
+  pollfd fd{ doorbell_, 0, 0 };
+  return poll(&fd, 1, 0) > 0 && (fd.revents & POLLERR);
+}
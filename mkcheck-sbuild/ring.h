@@ -0,0 +1,137 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+
+/**
+ * Memory-mapped single-producer, single-consumer ring of byte batches.
+ *
+ * The file starts with a page holding the header, followed by the data
+ * area. Positions are free-running byte counts: the producer only writes
+ * the head, the consumer only writes the tail. Batches are framed by an
+ * 8-byte header and padded to 8 bytes; a wrap message skips the end of the
+ * data area when a batch does not fit there.
+ *
+ * The producer never blocks on the consumer. When the ring is full, batches
+ * are appended to a spill file instead, next to the ring, and a spill
+ * message pointing to them is published once there is room again. Batches
+ * published while a spill is pending are spilled as well, so the order is
+ * kept. After publishing, the producer writes a byte to a non-blocking
+ * doorbell, which the consumer reads when it runs out of messages.
+ */
+namespace ring {
+
+/// Magic identifying the format and its version.
+constexpr uint64_t kMagic = 0x3130474e49524b4dull; // "MKRING01"
+
+/// Offset of the data area.
+constexpr size_t kDataOffset = 4096;
+
+/// Kinds of messages.
+enum Kind : uint32_t {
+  /// Bytes of a batch.
+  kData = 1,
+  /// Offset and length of a range of the spill file.
+  kSpill = 2,
+  /// Skip to the start of the data area.
+  kWrap = 3,
+};
+
+/// Header of the ring, shared between the processes.
+struct Header {
+  /// Magic, stored last by the producer once the ring is ready.
+  uint64_t Magic;
+  /// Size of the data area.
+  uint64_t Capacity;
+  /// Bytes published by the producer.
+  uint64_t Head;
+  /// Bytes released by the consumer.
+  uint64_t Tail;
+  /// Set by the producer once it is done.
+  uint64_t Closed;
+  /// Number of batches published.
+  uint64_t Batches;
+  /// Number of batches which did not go straight to the ring.
+  uint64_t Full;
+  /// Number of batches written to the spill file.
+  uint64_t SpilledBatches;
+  /// Number of bytes written to the spill file.
+  uint64_t SpilledBytes;
+  /// Largest number of bytes waiting in the ring.
+  uint64_t Peak;
+};
+
+/// Header of a message, followed by the payload and padding.
+struct Message {
+  uint32_t Length;
+  uint32_t Kind;
+};
+
+/// Payload of spill messages.
+struct Extent {
+  uint64_t Offset;
+  uint64_t Length;
+};
+
+}
+
+/**
+ * Producer side of a ring.
+ */
+class RingWriter final {
+public:
+  /// Creates the ring at a path, ringing the doorbell at another one.
+  RingWriter(const std::string &path, const std::string &doorbell, size_t capacity);
+  ~RingWriter();
+
+  /// Publishes a batch, spilling it if the ring is full.
+  void Publish(const char *data, size_t len);
+
+  /// Publishes pending spills, marks the ring closed and unmaps it.
+  void Close();
+
+  /// Returns the header, with the statistics of the ring.
+  const ring::Header &GetHeader() const { return *header_; }
+
+private:
+  /// Pushes a message, returning false if the ring is full.
+  bool Push(ring::Kind kind, const void *data, size_t len);
+  /// Pushes the pending spill extent, if any.
+  bool PushSpill();
+  /// Appends a batch to the spill file.
+  void Spill(const char *data, size_t len);
+  /// Wakes up the consumer.
+  void Ring();
+  /// Checks if the consumer closed its end of the doorbell.
+  bool IsAbandoned() const;
+
+private:
+  /// Path of the ring, used to name the spill file.
+  const std::string path_;
+  /// File descriptor of the ring.
+  int fd_;
+  /// File descriptor of the doorbell.
+  int doorbell_;
+  /// File descriptor of the spill file, or -1.
+  int spill_;
+  /// Mapping of the ring.
+  uint8_t *map_;
+  /// Size of the mapping.
+  size_t size_;
+  /// Header, in the mapping, or a copy of it once closed.
+  ring::Header *header_;
+  /// Copy of the header, kept after unmapping.
+  ring::Header stats_;
+  /// Data area, in the mapping.
+  uint8_t *data_;
+  /// Size of the spill file.
+  uint64_t spillSize_;
+  /// Range of the spill file not published yet.
+  ring::Extent pending_;
+};
@@ -0,0 +1,115 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "seccomp.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/utsname.h>
+
+
+
+// -----------------------------------------------------------------------------
+static constexpr int64_t kMaxSyscall = 512;
+
+// -----------------------------------------------------------------------------
+static sock_filter Stmt(uint16_t code, uint32_t k)
+{
+  return sock_filter{ code, 0, 0, k };
+}
+
+// -----------------------------------------------------------------------------
+static sock_filter Jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf)
+{
+  return sock_filter{ code, jt, jf, k };
+}
+
+// -----------------------------------------------------------------------------
+bool UseSeccomp()
+{
+  const char *env = getenv("MKCHECK_SECCOMP");
+  if (!env || !*env || strcmp(env, "0") == 0) {
+    return false;
+  }
+
+  // Before Linux 4.8, the seccomp stop precedes the syscall-entry stop, so
+  // resuming it with PTRACE_SYSCALL would stop at the entry, not the exit.
+  struct utsname uts;
+  unsigned major = 0, minor = 0;
+  if (uname(&uts) < 0 ||
+      sscanf(uts.release, "%u.%u", &major, &minor) != 2 ||
+      major < 4 || (major == 4 && minor < 8))
+  {
+    std::cerr << "[Warning] seccomp mode needs Linux 4.8" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+std::vector<sock_filter> BuildSeccompFilter()
+{
+  std::vector<int64_t> ignored;
+  for (int64_t sno = 0; sno < kMaxSyscall; ++sno) {
+    if (!IsTraced(sno)) {
+      ignored.push_back(sno);
+    }
+  }
+
+  // Each comparison jumps straight to the final RET_ALLOW, so the offset
+  // of the range check before them bounds the size of the table.
+  const size_t n = ignored.size();
+  if (n + 1 > 0xFF) {
+    throw std::runtime_error("Too many ignored syscalls for seccomp filter");
+  }
+
+  std::vector<sock_filter> prog;
+
+  // Foreign ABIs are traced unconditionally.
+  prog.push_back(Stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+  prog.push_back(Jump(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0));
+  prog.push_back(Stmt(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+
+  // The x32 ABI shares the architecture token, but sets a high bit.
+  prog.push_back(Stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+  prog.push_back(Jump(BPF_JMP | BPF_JGE | BPF_K, kMaxSyscall, n + 1, 0));
+
+  for (size_t i = 0; i < n; ++i) {
+    prog.push_back(Jump(BPF_JMP | BPF_JEQ | BPF_K, ignored[i], n - i, 0));
+  }
+
+  prog.push_back(Stmt(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+  prog.push_back(Stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  return prog;
+}
+
+// -----------------------------------------------------------------------------
+void InstallSeccompFilter()
+{
+  std::vector<sock_filter> filter = BuildSeccompFilter();
+
+  sock_fprog prog;
+  prog.len = filter.size();
+  prog.filter = filter.data();
+
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+    throw std::runtime_error(
+        "prctl(PR_SET_NO_NEW_PRIVS) failed: " + std::string(strerror(errno))
+    );
+  }
+  if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0) < 0) {
+    throw std::runtime_error(
+        "prctl(PR_SET_SECCOMP) failed: " + std::string(strerror(errno))
+    );
+  }
+}
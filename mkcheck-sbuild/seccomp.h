@@ -0,0 +1,50 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <linux/filter.h>
+
+
+
+/**
+ * Checks whether a system call must stop the tracee: it has a handler
+ * which records something, or it is missing from the spec.
+ *
+ * Defined in syscall.cpp, next to the handler table.
+ */
+bool IsTraced(int64_t sno);
+
+/**
+ * Checks whether the tracer should run in seccomp mode.
+ *
+ * The mode is enabled by setting MKCHECK_SECCOMP in the environment. It is
+ * refused on kernels older than 4.8, which stop for seccomp before the
+ * syscall-entry stop instead of after it.
+ */
+bool UseSeccomp();
+
+/**
+ * Builds a seccomp-BPF program from the handler table.
+ *
+ * The program returns SECCOMP_RET_ALLOW for syscalls the spec ignores, so
+ * futex, mprotect, brk and friends run without ever stopping the tracee,
+ * and SECCOMP_RET_TRACE for the rest, so syscalls missing from the spec
+ * are diagnosed as under ptrace. Syscalls from other ABIs are always
+ * traced, since their numbers do not match the x86_64 table.
+ */
+std::vector<sock_filter> BuildSeccompFilter();
+
+/**
+ * Installs the filter in the calling process.
+ *
+ * Must be called in the child after PTRACE_TRACEME, right before exec.
+ * The filter is inherited by all descendants. The tracer must enable
+ * PTRACE_O_TRACESECCOMP and resume tracees with PTRACE_CONT: on a
+ * PTRACE_EVENT_SECCOMP stop, it resumes with PTRACE_SYSCALL once in order
+ * to observe the exit of the syscall, which is then passed to Handle.
+ */
+void InstallSeccompFilter();
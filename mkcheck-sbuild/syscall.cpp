@@ -4,136 +4,432 @@
 
 #include "syscall.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/eventfd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-
+#include <sys/uio.h>
+
+#include "capture.h"
+#include "diag.h"
+#include "eventlog.h"
+#include "fdevents.h"
+#include "fdtable.h"
+#include "filter.h"
+#include "hash.h"
+#include "ir.h"
+#include "memory.h"
+#include "metrics.h"
+#include "path.h"
 #include "proc.h"
+#include "profile.h"
+#include "records.h"
+#include "seccomp.h"
+#include "tasks.h"
 #include "trace.h"
-#include "util.h"
+#include "uring.h"
+
+
+
+// Syscalls missing from older C library headers, numbered for x86_64.
+#ifdef __x86_64__
+#ifndef SYS_renameat2
+#define SYS_renameat2 316
+#endif
+#ifndef SYS_copy_file_range
+#define SYS_copy_file_range 326
+#endif
+#ifndef SYS_statx
+#define SYS_statx 332
+#endif
+#ifndef SYS_rseq
+#define SYS_rseq 334
+#endif
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425
+#endif
+#ifndef SYS_io_uring_enter
+#define SYS_io_uring_enter 426
+#endif
+#ifndef SYS_io_uring_register
+#define SYS_io_uring_register 427
+#endif
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+#ifndef SYS_faccessat2
+#define SYS_faccessat2 439
+#endif
+#endif
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
 
 
 
 // -----------------------------------------------------------------------------
-static void sys_read(Process *proc, const Args &args)
+static PathID GetCwd(Process *proc)
 {
-  if (args.Return >= 0) {
-    proc->AddInput(args[0]);
+  PathID cwd;
+  if (!GetResolveCache().GetCwd(proc->GetUID(), &cwd)) {
+    throw std::runtime_error("Unknown cwd");
   }
+  return cwd;
 }
 
 // -----------------------------------------------------------------------------
-static void sys_write(Process *proc, const Args &args)
+static bool FindFd(Process *proc, int fd, PathID *path, uint32_t *gen = nullptr)
 {
-  if (args.Return >= 0) {
-    proc->AddOutput(args[0]);
+  // Pipes and fds inherited by the root, other than the standard streams,
+  // do not name files.
+  return GetFdTables().Find(proc->GetUID(), fd, path, gen);
+}
+
+// -----------------------------------------------------------------------------
+static PathID Resolve(Process *proc, const std::string &path)
+{
+  return GetResolveCache().Resolve(GetCwd(proc), path);
+}
+
+// -----------------------------------------------------------------------------
+static PathID Resolve(Process *proc, int dirfd, const std::string &path)
+{
+  if (dirfd == AT_FDCWD || (!path.empty() && path[0] == '/')) {
+    return Resolve(proc, path);
+  }
+  PathID dir;
+  if (!FindFd(proc, dirfd, &dir)) {
+    throw std::runtime_error("Unknown fd " + std::to_string(dirfd));
   }
+  return GetResolveCache().Resolve(dir, path);
 }
 
 // -----------------------------------------------------------------------------
-static void sys_open(Process *proc, const Args &args)
+static bool IsExcluded(PathID path)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
-  const uint64_t flags = args[1];
-  const int fd = args.Return;
+  PathFilter *filter = GetPathFilter();
+  return filter && filter->Excludes(path);
+}
 
-  if (args.Return >= 0) {
-    proc->MapFd(fd, path);
-    proc->SetCloseExec(fd, flags & O_CLOEXEC);
+// -----------------------------------------------------------------------------
+static void AddProduced(PathID path)
+{
+  if (PathFilter *filter = GetPathFilter()) {
+    filter->AddProduced(path);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_close(Process *proc, const Args &args)
+static void AddInputPath(Process *proc, PathID path)
 {
-  if (args.Return >= 0) {
-    proc->CloseFd(args[0]);
+  // The records are filtered when written out, once the files produced by
+  // the build are known. Other consumers only see the files produced so far.
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->AddInput(proc->GetUID(), path);
+  }
+  if (IsExcluded(path)) {
+    return;
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddConsume(path);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->AddInput(proc->GetUID(), path);
+  }
+  if (HashPool *pool = GetHashPool()) {
+    pool->AddInput(path);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_stat(Process *proc, const Args &args)
+static void AddOutputPath(Process *proc, PathID path)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
-  if (args.Return >= 0) {
-    proc->AddTouched(path);
+  AddProduced(path);
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->AddOutput(proc->GetUID(), path);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddProduce(path);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->AddOutput(proc->GetUID(), path);
+  }
+  if (HashPool *pool = GetHashPool()) {
+    pool->AddOutput(path);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_fstat(Process *proc, const Args &args)
+static void AddTouchedPath(Process *proc, PathID path)
 {
-  if (args.Return >= 0) {
-    proc->AddTouched(args[0]);
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->AddTouched(proc->GetUID(), path);
+  }
+  if (IsExcluded(path)) {
+    return;
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddConsume(path);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_lstat(Process *proc, const Args &args)
+static void AddInput(Process *proc, int fd, int64_t bytes = 0)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+  PathID path;
+  uint32_t gen;
+  if (!FindFd(proc, fd, &path, &gen)) {
+    return;
+  }
+  if (GetFdEvents().Mark(proc->GetUID(), fd, gen, FdEvents::kInput)) {
+    AddInputPath(proc, path);
+  }
+  Profiler *profiler = GetProfiler();
+  if (profiler && bytes > 0) {
+    profiler->AddRead(proc->GetUID(), path, bytes);
+  }
+}
 
-  if (args.Return >= 0) {
-    proc->AddTouched(path);
+// -----------------------------------------------------------------------------
+static void AddOutput(Process *proc, int fd, int64_t bytes = 0)
+{
+  PathID path;
+  uint32_t gen;
+  if (!FindFd(proc, fd, &path, &gen)) {
+    return;
+  }
+  if (GetFdEvents().Mark(proc->GetUID(), fd, gen, FdEvents::kOutput)) {
+    AddProduced(path);
+    if (ProcessRecords *records = GetProcessRecords()) {
+      records->AddOutput(proc->GetUID(), path);
+    }
+    if (IrWriter *ir = GetIrWriter()) {
+      ir->AddProduce(path);
+    }
+    if (Profiler *profiler = GetProfiler()) {
+      profiler->AddOutput(proc->GetUID(), path);
+    }
+    if (HashPool *pool = GetHashPool()) {
+      pool->AddWritten(proc->GetUID(), fd, path);
+    }
+  }
+  Profiler *profiler = GetProfiler();
+  if (profiler && bytes > 0) {
+    profiler->AddWrite(proc->GetUID(), path, bytes);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_mmap(Process *proc, const Args &args)
+static void AddTouched(Process *proc, int fd)
 {
-  const int prot = args[2];
-  const int flags = args[3];
-  const int fd = args[4];
+  PathID path;
+  if (FindFd(proc, fd, &path)) {
+    AddTouchedPath(proc, path);
+  }
+}
 
-  if (args.Return != MAP_ANON && fd != -1) {
-    // Writes are only carried out to the file in shared, writable mappings.
-    if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
-      proc->AddOutput(fd);
-    } else {
-      proc->AddInput(fd);
-    }
+// -----------------------------------------------------------------------------
+static void ReleaseFd(Process *proc, int fd)
+{
+  // A file written through the fd is complete once the fd is released.
+  if (HashPool *pool = GetHashPool()) {
+    pool->Close(proc->GetUID(), fd);
   }
+  GetUringTable().Close(GetFdTables().GetID(proc->GetUID()), fd);
 }
 
 // -----------------------------------------------------------------------------
-static void sys_pread64(Process *proc, const Args &args)
+static void MapFd(Process *proc, int fd, PathID path)
 {
-  if (args.Return >= 0) {
-    proc->AddInput(args[0]);
+  ReleaseFd(proc, fd);
+  GetFdTables().Map(proc->GetUID(), fd, path);
+}
+
+// -----------------------------------------------------------------------------
+static void MapFd(Process *proc, int fd, const std::string &path)
+{
+  MapFd(proc, fd, GetPathTable().Intern(path));
+}
+
+// -----------------------------------------------------------------------------
+static void CloseFd(Process *proc, int fd)
+{
+  ReleaseFd(proc, fd);
+  GetFdTables().Close(proc->GetUID(), fd);
+}
+
+// -----------------------------------------------------------------------------
+static void DupFd(Process *proc, int oldfd, int newfd)
+{
+  ReleaseFd(proc, newfd);
+  GetFdTables().Dup(proc->GetUID(), oldfd, newfd);
+}
+
+// -----------------------------------------------------------------------------
+static void SetCloseExec(Process *proc, int fd, bool closeExec)
+{
+  GetFdTables().SetCloseExec(proc->GetUID(), fd, closeExec);
+}
+
+// -----------------------------------------------------------------------------
+static void Pipe(Process *proc, int rd, int wr)
+{
+  // Pipes do not name files: I/O on them is not recorded.
+  ReleaseFd(proc, rd);
+  ReleaseFd(proc, wr);
+  GetFdTables().Close(proc->GetUID(), rd);
+  GetFdTables().Close(proc->GetUID(), wr);
+}
+
+// -----------------------------------------------------------------------------
+static void SetCwd(Process *proc, PathID path)
+{
+  GetResolveCache().SetCwd(proc->GetUID(), path);
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddChdir(path);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void Rename(Process *proc, PathID from, PathID to)
+{
+  // Open fds of any process may now name a different file.
+  GetFdEvents().Clear();
+  AddProduced(to);
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->AddDependency(to, from);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddRename(from, to);
+  }
+  if (Profiler *profiler = GetProfiler()) {
+    profiler->Rename(from, to);
+  }
+  if (HashPool *pool = GetHashPool()) {
+    pool->AddOutput(to);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_readv(Process *proc, const Args &args)
+static void Link(Process *proc, PathID src, PathID dst)
+{
+  AddProduced(dst);
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->AddDependency(dst, src);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddLink(src, dst);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void Remove(Process *proc, PathID path)
+{
+  if (ProcessRecords *records = GetProcessRecords()) {
+    records->Remove(path);
+  }
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddDel(path);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static constexpr size_t kMaxMarkers = 4096;
+
+// -----------------------------------------------------------------------------
+static bool IsTaskChannel(Process *proc, int fd)
+{
+  Tasks *tasks = GetTasks();
+  PathID path;
+  return tasks && FindFd(proc, fd, &path) && tasks->IsChannel(path);
+}
+
+// -----------------------------------------------------------------------------
+static void sys_write(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    proc->AddInput(args[0]);
+    if (IsTaskChannel(proc, args[0])) {
+      std::string data(std::min<size_t>(args.Return, kMaxMarkers), '\0');
+      ReadGuestBuffer(args.PID, &data[0], args[1], data.size());
+      GetTasks()->Write(args.PID, data.data(), data.size());
+      return;
+    }
+    AddOutput(proc, args[0], args.Return);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_writev(Process *proc, const Args &args)
+static void sys_close(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    proc->AddInput(args[0]);
+    CloseFd(proc, args[0]);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_access(Process *proc, const Args &args)
+static void sys_mmap(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+  const int prot = args[2];
+  const int flags = args[3];
+  const int fd = args[4];
+
+  // Mappings of io_uring rings are recorded to decode submissions later.
+  if (args.Return >= 0 && fd != -1 &&
+      GetUringTable().Map(
+          GetFdTables().GetID(proc->GetUID()),
+          fd,
+          args[5],
+          args.Return))
+  {
+    return;
+  }
+
+  if (args.Return != MAP_ANON && fd != -1) {
+    // Writes are only carried out to the file in shared, writable mappings.
+    if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
+      AddOutput(proc, fd);
+    } else {
+      AddInput(proc, fd);
+    }
+  }
+}
 
+// -----------------------------------------------------------------------------
+static void sys_writev(Process *proc, const Args &args)
+{
   if (args.Return >= 0) {
-    proc->AddTouched(path);
+    if (IsTaskChannel(proc, args[0])) {
+      std::vector<iovec> iov(std::min<uint64_t>(args[2], IOV_MAX));
+      ReadGuestBuffer(args.PID, iov.data(), args[1], iov.size() * sizeof(iovec));
+
+      std::string data;
+      size_t left = std::min<size_t>(args.Return, kMaxMarkers);
+      for (const iovec &vec : iov) {
+        const size_t n = std::min(left, vec.iov_len);
+        const size_t size = data.size();
+        data.resize(size + n);
+        ReadGuestBuffer(args.PID, &data[size], reinterpret_cast<uint64_t>(vec.iov_base), n);
+        left -= n;
+      }
+      GetTasks()->Write(args.PID, data.data(), data.size());
+      return;
+    }
+    AddOutput(proc, args[0], args.Return);
   }
 }
 
@@ -141,9 +437,9 @@ static void sys_access(Process *proc, const Args &args)
 static void sys_pipe(Process *proc, const Args &args)
 {
   int fds[2];
-  ReadBuffer(args.PID, fds, args[0], 2 * sizeof(int));
+  ReadGuestBuffer(args.PID, fds, args[0], 2 * sizeof(int));
   if (args.Return >= 0) {
-    proc->Pipe(fds[0], fds[1]);
+    Pipe(proc, fds[0], fds[1]);
   }
 }
 
@@ -151,7 +447,7 @@ static void sys_pipe(Process *proc, const Args &args)
 static void sys_dup(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    proc->DupFd(args[0], args.Return);
+    DupFd(proc, args[0], args.Return);
   }
 }
 
@@ -159,7 +455,7 @@ static void sys_dup(Process *proc, const Args &args)
 static void sys_dup2(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    proc->DupFd(args[0], args.Return);
+    DupFd(proc, args[0], args.Return);
   }
 }
 
@@ -167,7 +463,7 @@ static void sys_dup2(Process *proc, const Args &args)
 static void sys_socket(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    proc->MapFd(args.Return, "/proc/network");
+    MapFd(proc, args.Return, "/proc/network");
   }
 }
 
@@ -180,17 +476,17 @@ static void sys_fcntl(Process *proc, const Args &args)
   if (args.Return >= 0) {
     switch (cmd) {
       case F_DUPFD: {
-        proc->DupFd(args[0], args.Return);
+        DupFd(proc, args[0], args.Return);
         break;
       }
       case F_DUPFD_CLOEXEC: {
-        proc->DupFd(args[0], args.Return);
-        proc->SetCloseExec(args.Return, false);
+        DupFd(proc, args[0], args.Return);
+        SetCloseExec(proc, args.Return, true);
         break;
       }
       case F_SETFD: {
         const int arg = args[2];
-        proc->SetCloseExec(fd, arg & FD_CLOEXEC);
+        SetCloseExec(proc, fd, arg & FD_CLOEXEC);
         break;
       }
       case F_GETFD:
@@ -217,29 +513,13 @@ static void sys_fcntl(Process *proc, const Args &args)
   }
 }
 
-// -----------------------------------------------------------------------------
-static void sys_ftruncate(Process *proc, const Args &args)
-{
-  if (args.Return >= 0) {
-    proc->AddOutput(args[0]);
-  }
-}
-
-// -----------------------------------------------------------------------------
-static void sys_getdents(Process *proc, const Args &args)
-{
-  if (args.Return >= 0) {
-    proc->AddInput(args[0]);
-  }
-}
-
 // -----------------------------------------------------------------------------
 static void sys_chdir(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+  const PathID path = Resolve(proc, ReadGuestString(args.PID, args[0]));
 
   if (args.Return >= 0) {
-    proc->SetCwd(path);
+    SetCwd(proc, path);
   }
 }
 
@@ -248,502 +528,576 @@ static void sys_fchdir(Process *proc, const Args &args)
 {
   const int fd = args[0];
   if (args.Return >= 0) {
-    proc->SetCwd(proc->GetFd(fd));
+    PathID path;
+    if (!FindFd(proc, fd, &path)) {
+      throw std::runtime_error("Unknown fd " + std::to_string(fd));
+    }
+    SetCwd(proc, path);
   }
 }
 
 // -----------------------------------------------------------------------------
 static void sys_rename(Process *proc, const Args &args)
 {
-  const fs::path src = proc->Normalise(ReadString(args.PID, args[0]));
-  const fs::path dst = proc->Normalise(ReadString(args.PID, args[1]));
+  const auto paths = ReadGuestStrings(args.PID, { args[0], args[1] });
+  const PathID src = Resolve(proc, paths[0]);
+  const PathID dst = Resolve(proc, paths[1]);
 
   if (args.Return >= 0) {
-    proc->Rename(src, dst);
+    Rename(proc, src, dst);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_mkdir(Process *proc, const Args &args)
+static void sys_link(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
-
   if (args.Return >= 0) {
-    proc->AddOutput(path);
-  }
-}
+    const auto paths = ReadGuestStrings(args.PID, { args[0], args[1] });
+    const PathID src = Resolve(proc, paths[0]);
+    const PathID dst = Resolve(proc, paths[1]);
 
-// -----------------------------------------------------------------------------
-static void sys_rmdir(Process *proc, const Args &args)
-{
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
-
-  if (args.Return >= 0) {
-    proc->Remove(path);
+    Link(proc, src, dst);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_link(Process *proc, const Args &args)
+static void sys_symlink(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    const fs::path srcRel = ReadString(args.PID, args[0]);
-    const fs::path dstRel = ReadString(args.PID, args[1]);
-
-    const fs::path src = proc->Normalise(srcRel);
-    const fs::path dstParent = proc->Normalise(dstRel.parent_path());
+    const auto paths = ReadGuestStrings(args.PID, { args[0], args[1] });
+    const PathID dstPath = Resolve(proc, paths[1]);
+    const PathID parent = ParentPath(dstPath);
+    const PathID srcPath = GetResolveCache().Resolve(parent, paths[0]);
 
-    proc->Link(src, dstParent / dstRel.filename());
+    // configure seems to create links pointing to themselves, which we ignore.
+    if (srcPath != dstPath) {
+      Link(proc, srcPath, dstPath);
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_creat(Process *proc, const Args &args)
+static void sys_symlinkat(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
-  const uint64_t flags = args[1];
-
   if (args.Return >= 0) {
-    const int fd = args.Return;
-    proc->MapFd(fd, path);
-    proc->SetCloseExec(fd, flags & O_CLOEXEC);
-  }
-}
-
-// -----------------------------------------------------------------------------
-static void sys_unlink(Process *proc, const Args &args)
-{
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+    const auto paths = ReadGuestStrings(args.PID, { args[0], args[2] });
+    const PathID dstPath = Resolve(proc, args[1], paths[1]);
+    const PathID parent = ParentPath(dstPath);
+    const PathID srcPath = GetResolveCache().Resolve(parent, paths[0]);
 
-  if (args.Return >= 0) {
-    proc->Remove(path);
+    if (srcPath != dstPath) {
+      Link(proc, srcPath, dstPath);
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_symlink(Process *proc, const Args &args)
+static void sys_linkat(Process *proc, const Args &args)
 {
   if (args.Return >= 0) {
-    const fs::path src = ReadString(args.PID, args[0]);
-    const fs::path dst = ReadString(args.PID, args[1]);
+    const auto paths = ReadGuestStrings(args.PID, { args[1], args[3] });
+    const PathID src = Resolve(proc, args[0], paths[0]);
+    const PathID dst = Resolve(proc, args[2], paths[1]);
 
-    const fs::path parent = proc->Normalise(dst.parent_path());
-    const fs::path srcPath = proc->Normalise(src, parent);
-    const fs::path dstPath = parent / dst.filename();
-
-    // configure seems to create links pointing to themselves, which we ignore.
-    if (srcPath != dstPath) {
-      proc->Link(srcPath, dstPath);
-    }
+    Link(proc, src, dst);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_readlink(Process *proc, const Args &args)
+static void sys_epoll_create(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
   if (args.Return >= 0) {
-    proc->AddInput(path);
+    MapFd(proc, args.Return, "/proc/" + std::to_string(args.PID) + "/epoll");
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_utime(Process *proc, const Args &args)
+static void sys_renameat(Process *proc, const Args &args)
 {
+  const auto paths = ReadGuestStrings(args.PID, { args[1], args[3] });
+  const int odirfd = args[0];
+  const PathID opath = Resolve(proc, odirfd, paths[0]);
+  const int ndirfd = args[2];
+  const PathID npath = Resolve(proc, ndirfd, paths[1]);
+
   if (args.Return >= 0) {
-    proc->AddOutput(proc->Normalise(ReadString(args.PID, args[0])));
+    Rename(proc, opath, npath);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_linkat(Process *proc, const Args &args)
+static void sys_splice(Process *proc, const Args &args)
 {
-  if (args.Return >= 0) {
-    const fs::path srcRel = ReadString(args.PID, args[1]);
-    const fs::path dstRel = ReadString(args.PID, args[3]);
-
-    const fs::path src = proc->Normalise(args[0], srcRel);
-    const fs::path dstParent = proc->Normalise(args[2], dstRel.parent_path());
+  const int fdIn = args[0];
+  const int fdOut = args[2];
 
-    proc->Link(src, dstParent / dstRel.filename());
+  if (args.Return >= 0) {
+    AddInput(proc, fdIn, args.Return);
+    AddOutput(proc, fdOut, args.Return);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_fsetxattr(Process *proc, const Args &args)
+static void sys_eventfd2(Process *proc, const Args &args)
 {
+  const int flags = args[1];
+  const int fd = args.Return;
+
   if (args.Return >= 0) {
-    proc->AddOutput(proc->GetFd(args[0]));
+    MapFd(proc, fd, "/proc/" + std::to_string(args.PID) + "/event");
+    SetCloseExec(proc, fd, flags & EFD_CLOEXEC);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_getxattr(Process *proc, const Args &args)
+static void sys_dup3(Process *proc, const Args &args)
 {
-  const fs::path path = ReadString(args.PID, args[0]);
-  const fs::path parent = proc->Normalise(path.parent_path());
+  const int oldfd = args[0];
+  const int newfd = args[1];
+  const int flags = args[2];
+
   if (args.Return >= 0) {
-      proc->AddInput(parent / path.filename());
+    DupFd(proc, oldfd, newfd);
+    SetCloseExec(proc, newfd, flags & O_CLOEXEC);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_lgetxattr(Process *proc, const Args &args)
+static void sys_pipe2(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+  int fds[2];
+  ReadGuestBuffer(args.PID, fds, args[0], 2 * sizeof(int));
+  const int flags = args[1];
+
   if (args.Return >= 0) {
-      proc->AddInput(path);
+    Pipe(proc, fds[0], fds[1]);
+
+    const bool closeExec = flags & O_CLOEXEC;
+    SetCloseExec(proc, fds[0], closeExec);
+    SetCloseExec(proc, fds[1], closeExec);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_llistxattr(Process *proc, const Args &args)
+static void sys_sendfile(Process *proc, const Args &args)
 {
-  const fs::path path = proc->Normalise(ReadString(args.PID, args[0]));
+  const int fdOut = args[0];
+  const int fdIn = args[1];
+
   if (args.Return >= 0) {
-      proc->AddInput(path);
+    AddInput(proc, fdIn, args.Return);
+    AddOutput(proc, fdOut, args.Return);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_flistxattr(Process *proc, const Args &args)
+static void sys_renameat2(Process *proc, const Args &args)
 {
-  throw std::runtime_error("not implemented");
-}
-
+  const auto paths = ReadGuestStrings(args.PID, { args[1], args[3] });
+  const PathID opath = Resolve(proc, args[0], paths[0]);
+  const PathID npath = Resolve(proc, args[2], paths[1]);
+  const unsigned flags = args[4];
 
-// -----------------------------------------------------------------------------
-static void sys_epoll_create(Process *proc, const Args &args)
-{
   if (args.Return >= 0) {
-    proc->MapFd(args.Return, "/proc/" + std::to_string(args.PID) + "/epoll");
+    if (flags & RENAME_EXCHANGE) {
+      // Both files persist, with swapped contents.
+      AddOutputPath(proc, opath);
+      AddOutputPath(proc, npath);
+    } else {
+      Rename(proc, opath, npath);
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_getdents64(Process *proc, const Args &args)
+static void sys_copy_file_range(Process *proc, const Args &args)
 {
+  const int fdIn = args[0];
+  const int fdOut = args[2];
+
   if (args.Return >= 0) {
-    proc->AddInput(args[0]);
+    AddInput(proc, fdIn, args.Return);
+    AddOutput(proc, fdOut, args.Return);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_openat(Process *proc, const Args &args)
+static void sys_openat2(Process *proc, const Args &args)
 {
   const int dirfd = args[0];
-  const fs::path path = proc->Normalise(dirfd, ReadString(args.PID, args[1]));
-  const uint64_t flags = args[2];
+  const PathID path = Resolve(proc, dirfd, ReadGuestString(args.PID, args[1]));
+
   if (args.Return >= 0) {
+    // struct open_how starts with the 64-bit flags.
+    uint64_t flags;
+    ReadGuestBuffer(args.PID, &flags, args[2], sizeof(flags));
+
     const int fd = args.Return;
-    proc->MapFd(fd, path);
-    proc->SetCloseExec(fd, flags & O_CLOEXEC);
+    MapFd(proc, fd, path);
+    SetCloseExec(proc, fd, flags & O_CLOEXEC);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_mkdirat(Process *proc, const Args &args)
+static void sys_io_uring_setup(Process *proc, const Args &args)
 {
-  const int dirfd = args[0];
-  const fs::path path = proc->Normalise(dirfd, ReadString(args.PID, args[1]));
-
   if (args.Return >= 0) {
-    proc->AddOutput(path);
+    const int fd = args.Return;
+    MapFd(proc, fd, "/proc/" + std::to_string(args.PID) + "/io_uring");
+    SetCloseExec(proc, fd, true);
+    GetUringTable().Setup(
+        args.PID,
+        GetFdTables().GetID(proc->GetUID()),
+        fd,
+        args[1]
+    );
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_newfstatat(Process *proc, const Args &args)
+static void UringOpen(Process *proc, PathID path, uint32_t flags)
 {
-  const int dirfd = args[0];
-  const fs::path path = proc->Normalise(dirfd, ReadString(args.PID, args[1]));
-
-  if (args.Return >= 0) {
-    proc->AddTouched(path);
+  // The fd is only known on completion, so the file is attributed directly.
+  if ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC))) {
+    AddOutputPath(proc, path);
+  } else {
+    AddInputPath(proc, path);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_renameat(Process *proc, const Args &args)
+static void UringSubmit(Process *proc, pid_t pid, const UringSqe &sqe)
 {
-  const int odirfd = args[0];
-  const fs::path opath = proc->Normalise(odirfd, ReadString(args.PID, args[1]));
-  const int ndirfd = args[2];
-  const fs::path npath = proc->Normalise(ndirfd, ReadString(args.PID, args[3]));
+  // Registered files cannot be traced back to a path.
+  if (sqe.Flags & kUringFixedFile) {
+    return;
+  }
 
-  if (args.Return >= 0) {
-    proc->Rename(opath, npath);
+  switch (sqe.Opcode) {
+    case kUringRead:
+    case kUringReadv:
+    case kUringReadFixed: {
+      AddInput(proc, sqe.Fd);
+      break;
+    }
+    case kUringWrite:
+    case kUringWritev:
+    case kUringWriteFixed:
+    case kUringFallocate: {
+      AddOutput(proc, sqe.Fd);
+      break;
+    }
+    case kUringSplice: {
+      AddInput(proc, sqe.SpliceFdIn);
+      AddOutput(proc, sqe.Fd);
+      break;
+    }
+    case kUringOpenat: {
+      const PathID path = Resolve(proc, sqe.Fd, ReadGuestString(pid, sqe.Addr));
+      UringOpen(proc, path, sqe.OpFlags);
+      break;
+    }
+    case kUringOpenat2: {
+      const PathID path = Resolve(proc, sqe.Fd, ReadGuestString(pid, sqe.Addr));
+      uint64_t flags;
+      ReadGuestBuffer(pid, &flags, sqe.Addr2, sizeof(flags));
+      UringOpen(proc, path, flags);
+      break;
+    }
+    case kUringStatx: {
+      const PathID path = Resolve(proc, sqe.Fd, ReadGuestString(pid, sqe.Addr));
+      AddTouchedPath(proc, path);
+      break;
+    }
+    case kUringRenameat: {
+      const auto paths = ReadGuestStrings(pid, { sqe.Addr, sqe.Addr2 });
+      const PathID opath = Resolve(proc, sqe.Fd, paths[0]);
+      const PathID npath = Resolve(proc, sqe.Len, paths[1]);
+      Rename(proc, opath, npath);
+      break;
+    }
+    case kUringUnlinkat: {
+      const PathID path = Resolve(proc, sqe.Fd, ReadGuestString(pid, sqe.Addr));
+      Remove(proc, path);
+      break;
+    }
+    case kUringMkdirat: {
+      const PathID path = Resolve(proc, sqe.Fd, ReadGuestString(pid, sqe.Addr));
+      AddOutputPath(proc, path);
+      break;
+    }
+    case kUringClose: {
+      CloseFd(proc, sqe.Fd);
+      break;
+    }
+    default: {
+      break;
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_unlinkat(Process *proc, const Args &args)
+static void sys_io_uring_enter(Process *proc, const Args &args)
 {
   const int fd = args[0];
-  const fs::path path = proc->Normalise(fd, ReadString(args.PID, args[1]));
 
-  if (args.Return >= 0) {
-    proc->Remove(path);
+  // Submissions are decoded even if the call failed later on, since
+  // consumed entries were passed on to the kernel.
+  const uint64_t table = GetFdTables().GetID(proc->GetUID());
+  for (const UringSqe &sqe : GetUringTable().Consume(args.PID, table, fd)) {
+    UringSubmit(proc, args.PID, sqe);
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_readlinkat(Process *proc, const Args &args)
+static void sys_execve(Process *proc, const Args &args)
 {
-  const int fd = args[0];
-  const fs::path path = proc->Normalise(fd, ReadString(args.PID, args[1]));
   if (args.Return >= 0) {
-    proc->AddInput(path);
+    // Ring fds are close-on-exec: a table the process kept to itself
+    // loses them, while a shared table is unshared and keeps them.
+    const uint64_t table = GetFdTables().GetID(proc->GetUID());
+    GetFdTables().Exec(proc->GetUID());
+    if (GetFdTables().GetID(proc->GetUID()) == table) {
+      GetUringTable().Drop(table);
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_faccessat(Process *proc, const Args &args)
+static void sys_ignore(Process *proc, const Args &args)
 {
-  const int fd = args[0];
-  const fs::path path = proc->Normalise(fd, ReadString(args.PID, args[1]));
-
-  if (args.Return >= 0) {
-    proc->AddInput(path);
-  }
 }
 
+typedef void (*HandlerFn) (Process *proc, const Args &args);
+
+// Kinds of arguments, as listed in syscalls.def.
+static constexpr uint64_t kPathArg  = 1ull << 0;
+static constexpr uint64_t kFdArg    = 1ull << 8;
+static constexpr uint64_t kFdsArg   = 1ull << 16;
+static constexpr uint64_t kFlagsArg = 1ull << 24;
+static constexpr uint64_t kRetFd    = 1ull << 32;
+
+/// Effects of the handlers generated by ACCESS in syscalls.def.
+enum class Access {
+  kRead,
+  kInput,
+  kOutput,
+  kTouch,
+  kRemove,
+  kOpen,
+};
+
 // -----------------------------------------------------------------------------
-static void sys_splice(Process *proc, const Args &args)
+static constexpr int FindArg(uint64_t args, uint64_t kind)
 {
-  throw std::runtime_error("not implemented");
+  for (int i = 0; i < 6; ++i) {
+    if (args & (kind << i)) {
+      return i;
+    }
+  }
+  return -1;
 }
 
 // -----------------------------------------------------------------------------
-static void sys_fallocate(Process *proc, const Args &args)
+static void AccessFd(Process *proc, Access access, int fd, int64_t bytes)
 {
-  if (args.Return >= 0) {
-    proc->AddOutput(args[0]);
+  switch (access) {
+    case Access::kRead: AddInput(proc, fd, bytes); break;
+    case Access::kInput: AddInput(proc, fd); break;
+    case Access::kOutput: AddOutput(proc, fd); break;
+    case Access::kTouch: AddTouched(proc, fd); break;
+    case Access::kRemove: break;
+    case Access::kOpen: break;
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_eventfd2(Process *proc, const Args &args)
+static void AccessPath(Process *proc, Access access, PathID path)
 {
-  const int flags = args[1];
-  const int fd = args.Return;
-
-  if (args.Return >= 0) {
-    proc->MapFd(fd, "/proc/" + std::to_string(args.PID) + "/event");
-    proc->SetCloseExec(fd, flags & EFD_CLOEXEC);
+  switch (access) {
+    case Access::kRead: AddInputPath(proc, path); break;
+    case Access::kInput: AddInputPath(proc, path); break;
+    case Access::kOutput: AddOutputPath(proc, path); break;
+    case Access::kTouch: AddTouchedPath(proc, path); break;
+    case Access::kRemove: Remove(proc, path); break;
+    case Access::kOpen: break;
   }
 }
 
 // -----------------------------------------------------------------------------
-static void sys_dup3(Process *proc, const Args &args)
+template <Access kAccess, uint64_t kArgs>
+static void sys_access(Process *proc, const Args &args)
 {
-  const int oldfd = args[0];
-  const int newfd = args[1];
-  const int flags = args[2];
+  constexpr int kPath = FindArg(kArgs, kPathArg);
+  constexpr int kFd = FindArg(kArgs, kFdArg);
+  constexpr int kFlags = FindArg(kArgs, kFlagsArg);
+  static_assert(kPath >= 0 || kFd >= 0, "ACCESS needs a path or an fd");
+  static_assert(
+      (kAccess != Access::kRemove && kAccess != Access::kOpen) || kPath >= 0,
+      "ACCESS needs a path to remove or open"
+  );
+  static_assert(kAccess != Access::kOpen || (kArgs & kRetFd), "Open returns an fd");
+
+  if (kPath < 0) {
+    if (args.Return >= 0) {
+      AccessFd(proc, kAccess, args[kFd], args.Return);
+    }
+    return;
+  }
 
-  if (args.Return >= 0) {
-    proc->DupFd(oldfd, newfd);
+  // Strings are read even if the call failed, so bad pointers are diagnosed.
+  const std::string path = ReadGuestString(args.PID, args[kPath]);
+  if (args.Return < 0) {
+    return;
+  }
+  if (kFd >= 0 && path.empty()) {
+    AccessFd(proc, kAccess, args[kFd], args.Return);
+    return;
   }
 
-  proc->SetCloseExec(newfd, flags & O_CLOEXEC);
+  const PathID file = kFd >= 0 ? Resolve(proc, args[kFd], path) : Resolve(proc, path);
+  if (kAccess == Access::kOpen) {
+    const int fd = args.Return;
+    MapFd(proc, fd, file);
+    SetCloseExec(proc, fd, kFlags >= 0 && (args[kFlags] & O_CLOEXEC));
+  } else {
+    AccessPath(proc, kAccess, file);
+  }
 }
 
-// -----------------------------------------------------------------------------
-static void sys_pipe2(Process *proc, const Args &args)
+#define NONE          0
+#define PATH(i)       (kPathArg << (i))
+#define AT_PATH(d, i) (FD(d) | PATH(i))
+#define FD(i)         (kFdArg << (i))
+#define FDS(i)        (kFdsArg << (i))
+#define FLAGS(i)      (kFlagsArg << (i))
+#define RET_FD        kRetFd
+
+/// Entry of the dispatch table.
+struct SyscallSpec {
+  /// Name of the syscall.
+  const char *Name;
+  /// Handler, run at syscall exit.
+  HandlerFn Handler;
+  /// Kinds of the arguments decoded by the handler.
+  uint64_t Args;
+};
+
+static const SyscallSpec kSyscalls[] =
 {
-  int fds[2];
-  ReadBuffer(args.PID, fds, args[0], 2 * sizeof(int));
-  const int flags = args[1];
+#define SYSCALL(name, handler, args) [SYS_##name] = { #name, handler, args },
+#define ACCESS(name, effect, args) \
+  [SYS_##name] = { #name, sys_access<Access::k##effect, args>, args },
+#include "syscalls.def"
+#undef SYSCALL
+#undef ACCESS
+};
 
-  if (args.Return >= 0) {
-    proc->Pipe(fds[0], fds[1]);
+#undef NONE
+#undef PATH
+#undef AT_PATH
+#undef FD
+#undef FDS
+#undef FLAGS
+#undef RET_FD
 
-    const bool closeExec = flags & O_CLOEXEC;
-    proc->SetCloseExec(fds[0], closeExec);
-    proc->SetCloseExec(fds[1], closeExec);
+// -----------------------------------------------------------------------------
+static const SyscallSpec *FindSyscall(int64_t sno)
+{
+  if (sno < 0 || static_cast<uint64_t>(sno) >= sizeof(kSyscalls) / sizeof(kSyscalls[0])) {
+    return nullptr;
   }
+  const SyscallSpec *spec = &kSyscalls[sno];
+  return spec->Handler ? spec : nullptr;
 }
 
 // -----------------------------------------------------------------------------
-static void sys_ignore(Process *proc, const Args &args)
+bool IsTraced(int64_t sno)
 {
+  const SyscallSpec *spec = FindSyscall(sno);
+  return !spec || spec->Handler != sys_ignore;
 }
 
-typedef void (*HandlerFn) (Process *proc, const Args &args);
+// -----------------------------------------------------------------------------
+unsigned GetStringArgs(int64_t sno)
+{
+  const SyscallSpec *spec = FindSyscall(sno);
+  return spec ? (spec->Args / kPathArg) & 0x3F : 0;
+}
 
-static const HandlerFn kHandlers[] =
-{
-  /* 0x000 */ [SYS_read              ] = sys_read,
-  /* 0x001 */ [SYS_write             ] = sys_write,
-  /* 0x002 */ [SYS_open              ] = sys_open,
-  /* 0x003 */ [SYS_close             ] = sys_close,
-  /* 0x004 */ [SYS_stat              ] = sys_stat,
-  /* 0x005 */ [SYS_fstat             ] = sys_fstat,
-  /* 0x006 */ [SYS_lstat             ] = sys_lstat,
-  /* 0x007 */ [SYS_poll              ] = sys_ignore,
-  /* 0x008 */ [SYS_lseek             ] = sys_ignore,
-  /* 0x009 */ [SYS_mmap              ] = sys_mmap,
-  /* 0x00A */ [SYS_mprotect          ] = sys_ignore,
-  /* 0x00B */ [SYS_munmap            ] = sys_ignore,
-  /* 0x00C */ [SYS_brk               ] = sys_ignore,
-  /* 0x00D */ [SYS_rt_sigaction      ] = sys_ignore,
-  /* 0x00E */ [SYS_rt_sigprocmask    ] = sys_ignore,
-  /* 0x00F */ [SYS_rt_sigreturn      ] = sys_ignore,
-  /* 0x010 */ [SYS_ioctl             ] = sys_ignore,
-  /* 0x011 */ [SYS_pread64           ] = sys_pread64,
-  /* 0x013 */ [SYS_readv             ] = sys_readv,
-  /* 0x014 */ [SYS_writev            ] = sys_writev,
-  /* 0x015 */ [SYS_access            ] = sys_access,
-  /* 0x016 */ [SYS_pipe              ] = sys_pipe,
-  /* 0x017 */ [SYS_select            ] = sys_ignore,
-  /* 0x018 */ [SYS_sched_yield       ] = sys_ignore,
-  /* 0x019 */ [SYS_mremap            ] = sys_ignore,
-  /* 0x01a */ [SYS_msync             ] = sys_ignore,
-  /* 0x01b */ [SYS_mincore           ] = sys_ignore,
-  /* 0x01c */ [SYS_madvise           ] = sys_ignore,
-  /* 0x020 */ [SYS_dup               ] = sys_dup,
-  /* 0x021 */ [SYS_dup2              ] = sys_dup2,
-  /* 0x023 */ [SYS_nanosleep         ] = sys_ignore,
-  /* 0x025 */ [SYS_alarm             ] = sys_ignore,
-  /* 0x026 */ [SYS_setitimer         ] = sys_ignore,
-  /* 0x027 */ [SYS_getpid            ] = sys_ignore,
-  /* 0x029 */ [SYS_socket            ] = sys_socket,
-  /* 0x02A */ [SYS_connect           ] = sys_ignore,
-  /* 0x02C */ [SYS_sendto            ] = sys_ignore,
-  /* 0x02D */ [SYS_recvfrom          ] = sys_ignore,
-  /* 0x02E */ [SYS_sendmsg           ] = sys_ignore,
-  /* 0x02F */ [SYS_recvmsg           ] = sys_ignore,
-  /* 0x031 */ [SYS_bind              ] = sys_ignore,
-  /* 0x033 */ [SYS_getsockname       ] = sys_ignore,
-  /* 0x034 */ [SYS_getpeername       ] = sys_ignore,
-  /* 0x035 */ [SYS_socketpair        ] = sys_ignore,
-  /* 0x036 */ [SYS_setsockopt        ] = sys_ignore,
-  /* 0x037 */ [SYS_getsockopt        ] = sys_ignore,
-  /* 0x038 */ [SYS_clone             ] = sys_ignore,
-  /* 0x039 */ [SYS_fork              ] = sys_ignore,
-  /* 0x03A */ [SYS_vfork             ] = sys_ignore,
-  /* 0x03B */ [SYS_execve            ] = sys_ignore,
-  /* 0x03D */ [SYS_wait4             ] = sys_ignore,
-  /* 0x03F */ [SYS_uname             ] = sys_ignore,
-  /* 0x048 */ [SYS_fcntl             ] = sys_fcntl,
-  /* 0x049 */ [SYS_flock             ] = sys_ignore,
-  /* 0x04A */ [SYS_fsync             ] = sys_ignore,
-  /* 0x04D */ [SYS_ftruncate         ] = sys_ftruncate,
-  /* 0x04E */ [SYS_getdents          ] = sys_getdents,
-  /* 0x04F */ [SYS_getcwd            ] = sys_ignore,
-  /* 0x050 */ [SYS_chdir             ] = sys_chdir,
-  /* 0x051 */ [SYS_fchdir            ] = sys_fchdir,
-  /* 0x052 */ [SYS_rename            ] = sys_rename,
-  /* 0x053 */ [SYS_mkdir             ] = sys_mkdir,
-  /* 0x054 */ [SYS_rmdir             ] = sys_rmdir,
-  /* 0x055 */ [SYS_creat             ] = sys_creat,
-  /* 0x056 */ [SYS_link              ] = sys_link,
-  /* 0x057 */ [SYS_unlink            ] = sys_unlink,
-  /* 0x058 */ [SYS_symlink           ] = sys_symlink,
-  /* 0x059 */ [SYS_readlink          ] = sys_readlink,
-  /* 0x05A */ [SYS_chmod             ] = sys_ignore,
-  /* 0x05B */ [SYS_fchmod            ] = sys_ignore,
-  /* 0x05C */ [SYS_chown             ] = sys_ignore,
-  /* 0x05F */ [SYS_umask             ] = sys_ignore,
-  /* 0x060 */ [SYS_gettimeofday      ] = sys_ignore,
-  /* 0x061 */ [SYS_getrlimit         ] = sys_ignore,
-  /* 0x062 */ [SYS_getrusage         ] = sys_ignore,
-  /* 0x063 */ [SYS_sysinfo           ] = sys_ignore,
-  /* 0x064 */ [SYS_times             ] = sys_ignore,
-  /* 0x066 */ [SYS_getuid            ] = sys_ignore,
-  /* 0x068 */ [SYS_getgid            ] = sys_ignore,
-  /* 0x06B */ [SYS_geteuid           ] = sys_ignore,
-  /* 0x06C */ [SYS_getegid           ] = sys_ignore,
-  /* 0x06D */ [SYS_setpgid           ] = sys_ignore,
-  /* 0x06E */ [SYS_getppid           ] = sys_ignore,
-  /* 0x06F */ [SYS_getpgrp           ] = sys_ignore,
-  /* 0x070 */ [SYS_setsid            ] = sys_ignore,
-  /* 0x071 */ [SYS_setreuid          ] = sys_ignore,
-  /* 0x073 */ [SYS_getgroups         ] = sys_ignore,
-  /* 0x07F */ [SYS_rt_sigpending     ] = sys_ignore,
-  /* 0x083 */ [SYS_sigaltstack       ] = sys_ignore,
-  /* 0x084 */ [SYS_utime             ] = sys_utime,
-  /* 0x087 */ [SYS_personality       ] = sys_ignore,
-  /* 0x089 */ [SYS_statfs            ] = sys_ignore,
-  /* 0x08A */ [SYS_fstatfs           ] = sys_ignore,
-  /* 0x09D */ [SYS_prctl             ] = sys_ignore,
-  /* 0x09E */ [SYS_arch_prctl        ] = sys_ignore,
-  /* 0x0A0 */ [SYS_setrlimit         ] = sys_ignore,
-  /* 0x0A5 */ [SYS_linkat            ] = sys_linkat,
-  /* 0x0BA */ [SYS_gettid            ] = sys_ignore,
-  /* 0x0BE */ [SYS_fsetxattr         ] = sys_fsetxattr,
-  /* 0x0BF */ [SYS_getxattr          ] = sys_getxattr,
-  /* 0x0C0 */ [SYS_lgetxattr         ] = sys_lgetxattr,
-  /* 0x0C3 */ [SYS_llistxattr        ] = sys_llistxattr,
-  /* 0x0C4 */ [SYS_flistxattr        ] = sys_flistxattr,
-  /* 0x0C9 */ [SYS_time              ] = sys_ignore,
-  /* 0x0CA */ [SYS_futex             ] = sys_ignore,
-  /* 0x0CB */ [SYS_sched_setaffinity ] = sys_ignore,
-  /* 0x0CC */ [SYS_sched_getaffinity ] = sys_ignore,
-  /* 0x0D5 */ [SYS_epoll_create      ] = sys_epoll_create,
-  /* 0x0D9 */ [SYS_getdents64        ] = sys_getdents64,
-  /* 0x0DA */ [SYS_set_tid_address   ] = sys_ignore,
-  /* 0x0DB */ [SYS_restart_syscall   ] = sys_ignore,
-  /* 0x0DE */ [SYS_timer_create      ] = sys_ignore,
-  /* 0x0DF */ [SYS_timer_settime     ] = sys_ignore,
-  /* 0x0E0 */ [SYS_timer_gettime     ] = sys_ignore,
-  /* 0x0E1 */ [SYS_timer_getoverrun  ] = sys_ignore,
-  /* 0x0E2 */ [SYS_timer_delete      ] = sys_ignore,
-  /* 0x0DD */ [SYS_fadvise64         ] = sys_ignore,
-  /* 0x0E4 */ [SYS_clock_gettime     ] = sys_ignore,
-  /* 0x0E5 */ [SYS_clock_getres      ] = sys_ignore,
-  /* 0x0E7 */ [SYS_exit_group        ] = sys_ignore,
-  /* 0x0E8 */ [SYS_epoll_wait        ] = sys_ignore,
-  /* 0x0E9 */ [SYS_epoll_ctl         ] = sys_ignore,
-  /* 0x0EA */ [SYS_tgkill            ] = sys_ignore,
-  /* 0x0EB */ [SYS_utimes            ] = sys_ignore,
-  /* 0x0F7 */ [SYS_waitid            ] = sys_ignore,
-  /* 0x101 */ [SYS_openat            ] = sys_openat,
-  /* 0x102 */ [SYS_mkdirat           ] = sys_mkdirat,
-  /* 0x106 */ [SYS_newfstatat        ] = sys_newfstatat,
-  /* 0x107 */ [SYS_unlinkat          ] = sys_unlinkat,
-  /* 0x108 */ [SYS_renameat          ] = sys_renameat,
-  /* 0x10B */ [SYS_readlinkat        ] = sys_readlinkat,
-  /* 0x10C */ [SYS_fchmodat          ] = sys_ignore,
-  /* 0x10D */ [SYS_faccessat         ] = sys_faccessat,
-  /* 0x10E */ [SYS_pselect6          ] = sys_ignore,
-  /* 0x10F */ [SYS_ppoll             ] = sys_ignore,
-  /* 0x111 */ [SYS_set_robust_list   ] = sys_ignore,
-  /* 0x113 */ [SYS_splice            ] = sys_splice,
-  /* 0x118 */ [SYS_utimensat         ] = sys_ignore,
-  /* 0x119 */ [SYS_epoll_pwait       ] = sys_ignore,
-  /* 0x11D */ [SYS_fallocate         ] = sys_fallocate,
-  /* 0x122 */ [SYS_eventfd2          ] = sys_eventfd2,
-  /* 0x123 */ [SYS_epoll_create1     ] = sys_ignore,
-  /* 0x124 */ [SYS_dup3              ] = sys_dup3,
-  /* 0x125 */ [SYS_pipe2             ] = sys_pipe2,
-  /* 0x12E */ [SYS_prlimit64         ] = sys_ignore,
-  /* 0x133 */ [SYS_sendmmsg          ] = sys_ignore,
-  /* 0x13E */ [SYS_getrandom         ] = sys_ignore,
-};
+// -----------------------------------------------------------------------------
+const char *GetSyscallName(int64_t sno)
+{
+  const SyscallSpec *spec = FindSyscall(sno);
+  return spec ? spec->Name : nullptr;
+}
 
 // -----------------------------------------------------------------------------
 void Handle(Trace *trace, int64_t sno, const Args &args)
 {
-  if (sno < 0) {
+  // Ignored syscalls do not affect the graph; under seccomp, they do not
+  // even stop the tracees.
+  if (sno < 0 || !IsTraced(sno)) {
+    return;
+  }
+
+  Process *proc = trace->GetTrace(args.PID);
+  if (!proc) {
+    GetDiagnostics().Add(sno, "Unknown process");
     return;
   }
 
-  if (sno > sizeof(kHandlers) / sizeof(kHandlers[0]) || !kHandlers[sno]) {
+  EventWriter *writer = GetEventWriter();
+
+  // Syscalls missing from the spec may have touched files.
+  const SyscallSpec *spec = FindSyscall(sno);
+  if (!spec) {
+    if (GetDiagnostics().Add(sno, "Unknown syscall")) {
+      std::cerr
+          << "[Diagnostic] Unknown syscall " << sno
+          << " in process " << proc->GetUID() << " ("
+          << GetPathTable().Get(proc->GetImage()) << ")" << std::endl;
+    }
+    if (writer) {
+      writer->AddSyscall(sno, args);
+    }
     return;
   }
 
-  auto *proc = trace->GetTrace(args.PID);
+  Metrics *metrics = GetMetrics();
+  if (metrics) {
+    metrics->BeginSyscall(args.PID, sno);
+  }
 
+  // Statements are attributed to the syscall.
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->SetSyscall(args.PID, spec->Name);
+  }
+
+  bool failed = false;
   try {
-    kHandlers[sno](proc, args);
+    spec->Handler(proc, args);
   } catch (std::exception &ex) {
-    throw std::runtime_error(
-        "Exception while handling syscall " + std::to_string(sno) +
-        " in process " + std::to_string(proc->GetUID()) + " (" +
-        trace->GetFileName(proc->GetImage()) +
-        "): " +
-        ex.what()
-    );
+    // The effects of this call are lost, but the trace goes on.
+    failed = true;
+    if (GetDiagnostics().Add(sno, ex.what())) {
+      std::cerr
+          << "[Diagnostic] Exception while handling " << spec->Name << " (" << sno << ")"
+          << " in process " << proc->GetUID() << " ("
+          << GetPathTable().Get(proc->GetImage())
+          << "): " << ex.what() << std::endl;
+    }
+  }
+
+  // Failures are logged as well, so they can be reproduced offline.
+  if (writer) {
+    writer->AddSyscall(sno, args);
+  }
+
+  if (metrics) {
+    // Failed calls are discarded by most handlers.
+    if (metrics->EndSyscall(failed || args.Return < 0)) {
+      metrics->SetImage(args.PID, GetPathTable().Get(proc->GetImage()));
+    }
   }
 }
@@ -0,0 +1,185 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "tasks.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "ir.h"
+#include "metrics.h"
+#include "profile.h"
+
+
+
+/// Markers of an instrumented build tool.
+struct Tool {
+  /// Prefix of all markers.
+  const char *Prefix;
+  /// Set if End names the task, like Begin does.
+  bool NamedEnd;
+};
+
+// -----------------------------------------------------------------------------
+static const Tool kTools[] = {
+  { "##MAKE## ", false },
+  { "##GRADLE## ", true },
+};
+
+// -----------------------------------------------------------------------------
+static bool StartsWith(const std::string &str, size_t pos, const char *prefix)
+{
+  return str.compare(pos, strlen(prefix), prefix) == 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+Tasks::Tasks(PathID channel)
+  : channel_(channel)
+  , next_(1)
+{
+}
+
+// -----------------------------------------------------------------------------
+void Tasks::Write(pid_t pid, const char *data, size_t len)
+{
+  const char *end = data + len;
+  while (data < end) {
+    const void *nl = memchr(data, '\n', end - data);
+    const char *eol = nl ? static_cast<const char *>(nl) : end;
+    if (eol != data) {
+      Marker(pid, std::string(data, eol - data));
+    }
+    data = eol + 1;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Tasks::Spawn(pid_t parent, pid_t pid)
+{
+  auto it = procs_.find(parent);
+  auto task = it == procs_.end() ? tasks_.end() : tasks_.find(it->second);
+  if (task != tasks_.end()) {
+    procs_[pid] = it->second;
+    if (Profiler *profiler = GetProfiler()) {
+      profiler->SetTask(pid, task->second.Record.Begin);
+    }
+  } else {
+    procs_.erase(pid);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Tasks::End(pid_t pid)
+{
+  // Markers are lost if the shell of a recipe is killed.
+  for (;;) {
+    auto it = procs_.find(pid);
+    if (it == procs_.end()) {
+      return;
+    }
+    auto task = tasks_.find(it->second);
+    if (task == tasks_.end() || task->second.Owner != pid) {
+      procs_.erase(it);
+      return;
+    }
+    Close(pid);
+  }
+}
+
+// -----------------------------------------------------------------------------
+TaskRecord *Tasks::Find(pid_t pid)
+{
+  auto it = procs_.find(pid);
+  if (it == procs_.end()) {
+    return nullptr;
+  }
+  auto task = tasks_.find(it->second);
+  return task == tasks_.end() ? nullptr : &task->second.Record;
+}
+
+// -----------------------------------------------------------------------------
+void Tasks::Marker(pid_t pid, const std::string &line)
+{
+  for (const Tool &tool : kTools) {
+    if (!StartsWith(line, 0, tool.Prefix)) {
+      continue;
+    }
+
+    const size_t pos = strlen(tool.Prefix);
+    if (StartsWith(line, pos, "Begin ")) {
+      auto it = procs_.find(pid);
+      Task &task = tasks_[next_];
+      task.Owner = pid;
+      task.Outer = it == procs_.end() ? 0 : it->second;
+      task.Record.Begin = line;
+      task.Record.End = std::string(tool.Prefix) + "End";
+      if (tool.NamedEnd) {
+        task.Record.End += line.substr(pos + 5);
+      }
+      task.Record.Started = GetTime();
+      procs_[pid] = next_++;
+      if (Profiler *profiler = GetProfiler()) {
+        profiler->SetTask(pid, line);
+      }
+      return;
+    }
+    if (line.compare(pos, std::string::npos, "End") == 0 || StartsWith(line, pos, "End ")) {
+      Close(pid);
+      return;
+    }
+
+    // Dependencies declared by the tool do not belong to any task.
+    if (IrWriter *ir = GetIrWriter()) {
+      ir->AddMarker(pid, line);
+    }
+    return;
+  }
+}
+
+// -----------------------------------------------------------------------------
+void Tasks::Close(pid_t pid)
+{
+  auto it = procs_.find(pid);
+  if (it == procs_.end()) {
+    return;
+  }
+  auto task = tasks_.find(it->second);
+  if (task == tasks_.end() || task->second.Owner != pid) {
+    return;
+  }
+
+  if (IrWriter *ir = GetIrWriter()) {
+    ir->AddTask(pid, task->second.Record);
+  }
+  Profiler *profiler = GetProfiler();
+  if (profiler) {
+    const TaskRecord &record = task->second.Record;
+    profiler->AddTask(record.Begin, record.Started, GetTime());
+  }
+  if (task->second.Outer) {
+    it->second = task->second.Outer;
+    auto outer = tasks_.find(it->second);
+    if (profiler && outer != tasks_.end()) {
+      profiler->SetTask(pid, outer->second.Record.Begin);
+    }
+  } else {
+    procs_.erase(it);
+  }
+  tasks_.erase(task);
+}
+
+// -----------------------------------------------------------------------------
+Tasks *GetTasks()
+{
+  static Tasks *tasks = [] () -> Tasks * {
+    const char *path = getenv("MKCHECK_TASKS");
+    if (!path || !*path) {
+      return nullptr;
+    }
+    // Never freed: the table is used by exit handlers.
+    return new Tasks(NormalisePath(std::string(), path, strlen(path)));
+  }();
+  return tasks;
+}
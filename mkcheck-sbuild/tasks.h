@@ -0,0 +1,110 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "path.h"
+
+
+
+/**
+ * Files touched by a build task, aggregated over all of its processes.
+ */
+struct TaskRecord {
+  /// Effects on a file.
+  enum Effect : uint8_t {
+    kConsumed  = 1 << 0,
+    kProduced  = 1 << 1,
+    kDirectory = 1 << 2,
+    kRemoved   = 1 << 3,
+  };
+
+  /// Link created by the task.
+  struct Link {
+    PathID Src;
+    PathID Dst;
+    bool Symbolic;
+  };
+
+  /// Marker which started the task.
+  std::string Begin;
+  /// Marker which ends the task.
+  std::string End;
+  /// Time the task started, for the profile.
+  uint64_t Started;
+  /// Effects on each file.
+  std::unordered_map<PathID, uint8_t> Effects;
+  /// Links, in order.
+  std::vector<Link> Links;
+};
+
+/**
+ * Build tasks delimited by the markers of the instrumented build tools.
+ *
+ * fsmake-shell and the Gradle plugin write lines such as
+ * "##MAKE## Begin <dir>:<target>" and "##MAKE## End" to the file named by
+ * MKCHECK_TASKS. The process writing Begin, along with every process it
+ * spawns afterwards, runs the task until it writes End or exits. A Begin
+ * inside a task nests a new task, which resumes the outer one once ended.
+ * Other markers are passed through as they are.
+ *
+ * Processes are keyed by PID: they are only looked up while alive.
+ */
+class Tasks final {
+public:
+  Tasks(PathID channel);
+
+  /// Checks if a file is the channel of the markers.
+  bool IsChannel(PathID path) const { return path == channel_; }
+
+  /// Decodes the markers written by a process to the channel.
+  void Write(pid_t pid, const char *data, size_t len);
+  /// Makes a new process run the task of its parent.
+  void Spawn(pid_t parent, pid_t pid);
+  /// Ends the tasks left open by a process which exited.
+  void End(pid_t pid);
+
+  /// Returns the task run by a process, or nullptr.
+  TaskRecord *Find(pid_t pid);
+
+private:
+  /// Handles a single marker.
+  void Marker(pid_t pid, const std::string &line);
+  /// Ends the innermost task started by a process.
+  void Close(pid_t pid);
+
+private:
+  /// Open task.
+  struct Task {
+    /// Process which started the task.
+    pid_t Owner;
+    /// Task run by the owner before this one, or 0.
+    uint64_t Outer;
+    /// Aggregated effects.
+    TaskRecord Record;
+  };
+
+  /// File the markers are written to.
+  const PathID channel_;
+  /// Next task ID.
+  uint64_t next_;
+  /// Open tasks.
+  std::unordered_map<uint64_t, Task> tasks_;
+  /// Task run by each process.
+  std::unordered_map<pid_t, uint64_t> procs_;
+};
+
+/**
+ * Returns the task table, or nullptr if MKCHECK_TASKS is not set.
+ *
+ * The variable holds the absolute path of the channel. Ended tasks are
+ * written to the IR, if enabled, as a single block.
+ */
+Tasks *GetTasks();
@@ -0,0 +1,9 @@
+# Tracer tests: test-tracer runs the programs of test.cpp under mkcheck.
+add_executable(mkcheck-test-cases mkcheck/test.cpp)
+enable_testing()
+add_test(
+    NAME tracer
+    COMMAND ${CMAKE_CURRENT_LIST_DIR}/test-tracer
+        --tool=$<TARGET_FILE:mkcheck>
+        --cases=$<TARGET_FILE:mkcheck-test-cases>
+)
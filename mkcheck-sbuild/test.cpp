@@ -0,0 +1,264 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+// Programs run under the tracer by test-tracer. Each one issues a few
+// syscalls which the tracer must survive or record in a particular way.
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef AT_EMPTY_PATH
+#define AT_EMPTY_PATH 0x1000
+#endif
+
+
+
+/// Program run by a test, in the directory given to it.
+struct Case {
+  /// Name of the case, as passed on the command line.
+  const char *Name;
+  /// Issues the syscalls of the test.
+  std::function<void(const std::string &)> Run;
+};
+
+// -----------------------------------------------------------------------------
+static void *GetUnmappedPage()
+{
+  const size_t size = sysconf(_SC_PAGESIZE);
+  void *page = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  munmap(page, size);
+  return page;
+}
+
+// -----------------------------------------------------------------------------
+static void BadPaths(const std::string &)
+{
+  // Paths are passed to the raw syscalls, since the C library would
+  // reject some of them before they reach the kernel.
+  struct stat st;
+  char buffer[256];
+  const void *paths[] = { nullptr, GetUnmappedPage() };
+  for (const void *path : paths) {
+    syscall(SYS_open, path, O_RDONLY);
+    syscall(SYS_openat, AT_FDCWD, path, O_RDONLY);
+    syscall(SYS_stat, path, &st);
+    syscall(SYS_newfstatat, AT_FDCWD, path, &st, AT_EMPTY_PATH);
+    syscall(SYS_statx, AT_FDCWD, path, AT_EMPTY_PATH, 0xFFF, buffer);
+    syscall(SYS_chdir, path);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void Writev(const std::string &dir)
+{
+  const std::string path = dir + "/writev.out";
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("open");
+    exit(EXIT_FAILURE);
+  }
+  char head[] = "head\n", tail[] = "tail\n";
+  const struct iovec iov[] = {
+    { head, sizeof(head) - 1 },
+    { tail, sizeof(tail) - 1 },
+  };
+  if (writev(fd, iov, 2) < 0) {
+    perror("writev");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+}
+
+// -----------------------------------------------------------------------------
+static int OpenShared(void *arg)
+{
+  const std::string &path = *static_cast<const std::string *>(arg);
+  return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) < 0;
+}
+
+// -----------------------------------------------------------------------------
+static void CloneFiles(const std::string &dir)
+{
+  // The child opens the file in the table it shares with the parent, which
+  // then writes to the fd: the lowest free one, after the standard streams.
+  const std::string path = dir + "/clone-files.out";
+  static char stack[1 << 16];
+  const pid_t pid = clone(
+      OpenShared,
+      stack + sizeof(stack),
+      CLONE_FILES | SIGCHLD,
+      const_cast<std::string *>(&path)
+  );
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+    perror("clone");
+    exit(EXIT_FAILURE);
+  }
+  if (write(STDERR_FILENO + 1, "data\n", 5) != 5) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static int Reopen(void *arg)
+{
+  close(STDERR_FILENO + 1);
+  return OpenShared(arg);
+}
+
+// -----------------------------------------------------------------------------
+static void CloneReopen(const std::string &dir)
+{
+  // The parent writes to a file, then the child replaces its fd in the
+  // shared table with another file, which the parent writes to as well.
+  const std::string first = dir + "/clone-first.out";
+  const std::string second = dir + "/clone-reopen.out";
+  const int fd = open(first.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write(fd, "data\n", 5) != 5) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+
+  static char stack[1 << 16];
+  const pid_t pid = clone(
+      Reopen,
+      stack + sizeof(stack),
+      CLONE_FILES | SIGCHLD,
+      const_cast<std::string *>(&second)
+  );
+  int status;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+    perror("clone");
+    exit(EXIT_FAILURE);
+  }
+  if (write(fd, "data\n", 5) != 5) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void UringReuse(const std::string &dir)
+{
+  // The fd of a closed ring is reused by a file, whose mapping is an input.
+  const std::string path = dir + "/uring-reuse.in";
+  const int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0 || write(out, "data\n", 5) != 5 || close(out) < 0) {
+    perror("write");
+    exit(EXIT_FAILURE);
+  }
+
+  char params[120] = { 0 };
+  const int ring = syscall(SYS_io_uring_setup, 1, params);
+  if (ring >= 0) {
+    close(ring);
+  }
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0 || (ring >= 0 && fd != ring)) {
+    perror("open");
+    exit(EXIT_FAILURE);
+  }
+  if (mmap(nullptr, 5, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void ForkExec(const std::string &dir)
+{
+  // One child only forks, the other one runs a new image.
+  for (const bool exec : { false, true }) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      if (exec) {
+        execl("/bin/true", "true", nullptr);
+      }
+      _exit(exec ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || status != 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+static void Symlinkat(const std::string &dir)
+{
+  const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0 || symlinkat("target", fd, "symlinkat.out") < 0) {
+    perror("symlinkat");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+}
+
+// -----------------------------------------------------------------------------
+static void UnknownSyscall(const std::string &)
+{
+  // getcpu is missing from the spec.
+  unsigned cpu, node;
+  syscall(SYS_getcpu, &cpu, &node, nullptr);
+}
+
+// -----------------------------------------------------------------------------
+static const std::vector<Case> kCases = {
+  { "bad-paths", BadPaths },
+  { "writev", Writev },
+  { "clone-files", CloneFiles },
+  { "clone-reopen", CloneReopen },
+  { "uring-reuse", UringReuse },
+  { "fork-exec", ForkExec },
+  { "symlinkat", Symlinkat },
+  { "unknown-syscall", UnknownSyscall },
+};
+
+// -----------------------------------------------------------------------------
+static void Usage(const char *argv0)
+{
+  std::cerr << "Usage: " << argv0 << " CASE DIR" << std::endl;
+  std::cerr << std::endl << "Cases:";
+  for (const auto &test : kCases) {
+    std::cerr << " " << test.Name;
+  }
+  std::cerr << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  if (argc != 3) {
+    Usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for (const auto &test : kCases) {
+    if (strcmp(test.Name, argv[1]) == 0) {
+      test.Run(argv[2]);
+      return EXIT_SUCCESS;
+    }
+  }
+  Usage(argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,3 @@
+# Content fingerprints are computed on background threads.
+find_package(Threads REQUIRED)
+target_link_libraries(mkcheck Threads::Threads)
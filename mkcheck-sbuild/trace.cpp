@@ -0,0 +1,101 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "lifecycle.h"
+#include "path.h"
+#include "records.h"
+
+
+
+// -----------------------------------------------------------------------------
+static ProcessRecords::Format GetFormat()
+{
+  const char *env = getenv("MKCHECK_STREAM");
+  if (env && *env && strcmp(env, "0") != 0) {
+    return ProcessRecords::Format::kStream;
+  }
+  return ProcessRecords::Format::kGraph;
+}
+
+// -----------------------------------------------------------------------------
+Trace::Trace(const std::string &output)
+  : nextUID_(1)
+  , records_(new ProcessRecords(output, GetFormat()))
+{
+  SetProcessRecords(records_.get());
+}
+
+// -----------------------------------------------------------------------------
+Trace::~Trace()
+{
+  // Processes still running are ended in the order they were created.
+  std::vector<std::pair<uint64_t, pid_t>> live;
+  for (const auto &it : procs_) {
+    live.emplace_back(it.second.GetUID(), it.first);
+  }
+  std::sort(live.begin(), live.end());
+  for (const auto &proc : live) {
+    EndTrace(proc.second);
+  }
+
+  records_->Close();
+  SetProcessRecords(nullptr);
+}
+
+// -----------------------------------------------------------------------------
+void Trace::SpawnTrace(pid_t parent, pid_t pid, uint64_t flags)
+{
+  auto it = procs_.find(parent);
+  if (it == procs_.end()) {
+    throw std::runtime_error("Unknown parent " + std::to_string(parent));
+  }
+  const uint64_t parentUID = it->second.GetUID();
+  const PathID image = it->second.GetImage();
+
+  // The previous owner of the PID exited without being seen.
+  if (procs_.count(pid)) {
+    EndTrace(pid);
+  }
+  procs_.emplace(pid, Process(pid, nextUID_++, parentUID, image));
+  OnSpawn(this, parent, pid, flags);
+}
+
+// -----------------------------------------------------------------------------
+void Trace::StartTrace(pid_t pid, const std::string &image, const std::string &cwd)
+{
+  const PathID id = GetPathTable().Intern(image);
+  auto it = procs_.find(pid);
+  if (it != procs_.end()) {
+    it->second.SetImage(id);
+    OnExec(this, pid);
+    return;
+  }
+  procs_.emplace(pid, Process(pid, nextUID_++, 0, id));
+  OnStart(this, pid, cwd);
+}
+
+// -----------------------------------------------------------------------------
+void Trace::EndTrace(pid_t pid)
+{
+  if (procs_.count(pid) == 0) {
+    return;
+  }
+  OnEnd(this, pid);
+  procs_.erase(pid);
+}
+
+// -----------------------------------------------------------------------------
+Process *Trace::GetTrace(pid_t pid)
+{
+  auto it = procs_.find(pid);
+  return it == procs_.end() ? nullptr : &it->second;
+}
@@ -0,0 +1,52 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+#include "proc.h"
+
+class ProcessRecords;
+
+
+
+/**
+ * Processes of a traced build.
+ *
+ * The trace maps PIDs to the running processes and assigns their UIDs. It
+ * calls the lifecycle hooks (see lifecycle.h) as processes are created,
+ * exec and exit, and owns the records the graph is written from (see
+ * records.h). Setting MKCHECK_STREAM writes the graph as a stream.
+ */
+class Trace final {
+public:
+  /// Creates a trace writing its graph to a file.
+  Trace(const std::string &output);
+  /// Ends the processes still running and writes out the graph.
+  ~Trace();
+
+  /// A process was created by fork, vfork or clone, with the clone flags.
+  void SpawnTrace(pid_t parent, pid_t pid, uint64_t flags);
+  /// A process started running an image: the root, in a directory, or a
+  /// process on exec, which keeps its own directory.
+  void StartTrace(pid_t pid, const std::string &image, const std::string &cwd);
+  /// A process exited.
+  void EndTrace(pid_t pid);
+
+  /// Returns a running process, or nullptr if the PID is not traced.
+  Process *GetTrace(pid_t pid);
+
+private:
+  /// Next UID to assign, 0 standing for no parent.
+  uint64_t nextUID_;
+  /// Running processes, by PID.
+  std::unordered_map<pid_t, Process> procs_;
+  /// Records of the processes.
+  std::unique_ptr<ProcessRecords> records_;
+};
@@ -0,0 +1,147 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#include "uring.h"
+
+#include "memory.h"
+
+
+
+static_assert(sizeof(UringSqe) == 64, "invalid io_uring_sqe layout");
+
+/// Ring layout, mirroring struct io_uring_params.
+struct UringParams {
+  uint32_t SqEntries;
+  uint32_t CqEntries;
+  uint32_t Flags;
+  uint32_t SqThreadCpu;
+  uint32_t SqThreadIdle;
+  uint32_t Features;
+  uint32_t WqFd;
+  uint32_t Resv[3];
+  struct {
+    uint32_t Head;
+    uint32_t Tail;
+    uint32_t RingMask;
+    uint32_t RingEntries;
+    uint32_t Flags;
+    uint32_t Dropped;
+    uint32_t Array;
+    uint32_t Resv1;
+    uint64_t UserAddr;
+  } SqOff;
+  struct {
+    uint32_t Head;
+    uint32_t Tail;
+    uint32_t RingMask;
+    uint32_t RingEntries;
+    uint32_t Overflow;
+    uint32_t Cqes;
+    uint32_t Flags;
+    uint32_t Resv1;
+    uint64_t UserAddr;
+  } CqOff;
+};
+
+static_assert(sizeof(UringParams) == 120, "invalid io_uring_params layout");
+
+// -----------------------------------------------------------------------------
+static constexpr uint64_t kOffSqRing = 0ull;
+static constexpr uint64_t kOffSqes = 0x10000000ull;
+static constexpr uint64_t kOffMask = 0xf8000000ull;
+
+static constexpr uint32_t kSetupSqe128 = 1u << 10;
+static constexpr uint32_t kSetupNoSqArray = 1u << 16;
+
+
+
+// -----------------------------------------------------------------------------
+void UringTable::Setup(pid_t pid, uint64_t table, int fd, uint64_t params)
+{
+  UringParams p;
+  ReadGuestBuffer(pid, &p, params, sizeof(p));
+
+  Ring &ring = rings_[std::make_pair(table, fd)];
+  ring.Entries = p.SqEntries;
+  ring.Flags = p.Flags;
+  ring.HeadOffset = p.SqOff.Head;
+  ring.ArrayOffset = p.SqOff.Array;
+  ring.SqRing = 0;
+  ring.Sqes = 0;
+  ring.Head = 0;
+}
+
+// -----------------------------------------------------------------------------
+bool UringTable::Map(uint64_t table, int fd, uint64_t offset, uint64_t addr)
+{
+  auto it = rings_.find(std::make_pair(table, fd));
+  if (it == rings_.end()) {
+    return false;
+  }
+
+  switch (offset & kOffMask) {
+    case kOffSqRing: it->second.SqRing = addr; break;
+    case kOffSqes: it->second.Sqes = addr; break;
+    default: break;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+std::vector<UringSqe> UringTable::Consume(pid_t pid, uint64_t table, int fd)
+{
+  std::vector<UringSqe> sqes;
+
+  auto it = rings_.find(std::make_pair(table, fd));
+  if (it == rings_.end() || !it->second.SqRing || !it->second.Sqes) {
+    return sqes;
+  }
+  Ring &ring = it->second;
+
+  uint32_t head;
+  ReadGuestBuffer(pid, &head, ring.SqRing + ring.HeadOffset, sizeof(head));
+
+  const uint32_t mask = ring.Entries - 1;
+  const size_t size = (ring.Flags & kSetupSqe128) ? 128 : 64;
+  for (uint32_t pos = ring.Head; pos != head; ++pos) {
+    uint32_t index = pos & mask;
+    if (!(ring.Flags & kSetupNoSqArray)) {
+      const uint64_t slot = ring.SqRing + ring.ArrayOffset + index * sizeof(index);
+      ReadGuestBuffer(pid, &index, slot, sizeof(index));
+      if (index > mask) {
+        continue;
+      }
+    }
+
+    UringSqe sqe;
+    ReadGuestBuffer(pid, &sqe, ring.Sqes + index * size, sizeof(sqe));
+    sqes.push_back(sqe);
+  }
+  ring.Head = head;
+  return sqes;
+}
+
+// -----------------------------------------------------------------------------
+void UringTable::Fork(uint64_t parent, uint64_t child)
+{
+  auto it = rings_.lower_bound(std::make_pair(parent, INT_MIN));
+  for (; it != rings_.end() && it->first.first == parent; ++it) {
+    rings_.emplace(std::make_pair(child, it->first.second), it->second);
+  }
+}
+
+// -----------------------------------------------------------------------------
+void UringTable::Drop(uint64_t table)
+{
+  rings_.erase(
+      rings_.lower_bound(std::make_pair(table, INT_MIN)),
+      rings_.upper_bound(std::make_pair(table, INT_MAX))
+  );
+}
+
+// -----------------------------------------------------------------------------
+UringTable &GetUringTable()
+{
+  static UringTable table;
+  return table;
+}
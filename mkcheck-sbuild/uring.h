@@ -0,0 +1,108 @@
+// This file is part of the mkcheck project.
+// Licensing information can be found in the LICENSE file.
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+
+
+/// Submission queue entry, mirroring struct io_uring_sqe.
+struct UringSqe {
+  uint8_t Opcode;
+  uint8_t Flags;
+  uint16_t IoPrio;
+  int32_t Fd;
+  uint64_t Addr2;
+  uint64_t Addr;
+  uint32_t Len;
+  uint32_t OpFlags;
+  uint64_t UserData;
+  uint16_t BufIndex;
+  uint16_t Personality;
+  int32_t SpliceFdIn;
+  uint64_t Addr3;
+  uint64_t Pad;
+};
+
+/// io_uring opcodes which access files.
+enum UringOpcode : uint8_t {
+  kUringReadv      = 1,
+  kUringWritev     = 2,
+  kUringReadFixed  = 4,
+  kUringWriteFixed = 5,
+  kUringFallocate  = 17,
+  kUringOpenat     = 18,
+  kUringClose      = 19,
+  kUringStatx      = 21,
+  kUringRead       = 22,
+  kUringWrite      = 23,
+  kUringOpenat2    = 28,
+  kUringSplice     = 30,
+  kUringRenameat   = 35,
+  kUringUnlinkat   = 36,
+  kUringMkdirat    = 37,
+  kUringSymlinkat  = 38,
+  kUringLinkat     = 39,
+};
+
+/// Flag marking an fd as an index into the registered file table.
+static constexpr uint8_t kUringFixedFile = 1 << 0;
+
+/**
+ * Tracks the submission rings of the io_uring instances of tracees.
+ *
+ * Rings are indexed by the fd table holding them, so threads sharing the
+ * table see the same ring and a reused pid never inherits a stale one. The
+ * kernel reports the ring layout through io_uring_setup and the tracee
+ * maps the rings with mmap on the ring fd. When it enters the ring, the
+ * entries between the last head seen and the head published by the kernel
+ * are read back from tracee memory; they stay intact until io_uring_enter
+ * returns to the tracee.
+ */
+class UringTable final {
+public:
+  /// Records a new ring, reading its parameters from the tracee.
+  void Setup(pid_t pid, uint64_t table, int fd, uint64_t params);
+
+  /// Records a mapping of a ring. Returns false if fd is not a ring.
+  bool Map(uint64_t table, int fd, uint64_t offset, uint64_t addr);
+
+  /// Returns the entries consumed by the kernel since the last call.
+  std::vector<UringSqe> Consume(pid_t pid, uint64_t table, int fd);
+
+  /// Copies the rings of a table into the copy made for a child.
+  void Fork(uint64_t parent, uint64_t child);
+
+  /// Forgets the ring behind an fd which was closed or replaced.
+  void Close(uint64_t table, int fd) { rings_.erase(std::make_pair(table, fd)); }
+
+  /// Forgets all rings of a table which is no longer used.
+  void Drop(uint64_t table);
+
+private:
+  /// Layout of a ring in tracee memory.
+  struct Ring {
+    uint32_t Entries;
+    uint32_t Flags;
+    uint32_t HeadOffset;
+    uint32_t ArrayOffset;
+    uint64_t SqRing;
+    uint64_t Sqes;
+    uint32_t Head;
+  };
+
+  /// Rings, indexed by fd table and fd.
+  std::map<std::pair<uint64_t, int>, Ring> rings_;
+};
+
+/**
+ * Returns the table shared by all handlers.
+ */
+UringTable &GetUringTable();
@@ -37,18 +37,31 @@ module type ToolParserType =
 
   val model_syscall : string -> Syntax.statement
 
+  val model_marker : string -> Syntax.statement
+
   val stop_parser : string -> bool
   end
 
 
 module type S =
   sig
+    val syscalls : string list
+
     val parse_trace_fd :
       string option
       -> Unix.file_descr
       -> Syntax.trace Syntax.stream
 
     val parse_trace_file : string option -> string -> Syntax.trace Syntax.stream
+
+    val parse_binary_fd :
+      string option
+      -> Unix.file_descr
+      -> Syntax.trace Syntax.stream
+
+    val parse_binary_file : string option -> string -> Syntax.trace Syntax.stream
+
+    val parse_binary_ring : string option -> Ir_ring.t -> Syntax.trace Syntax.stream
   end
 
 
@@ -290,9 +303,6 @@ module Make (T : ToolParserType) = struct
                                         (to_newfd (Some 0) 1);
                                         (model_open (Some 0) 1);
                                       ]
-    |> Util.Strings.add "pread"       [to_nop]
-    |> Util.Strings.add "pwrite"      [to_nop]
-    |> Util.Strings.add "read"        [to_nop]
     |> Util.Strings.add "readlink"    [(to_consume None 0)]
     |> Util.Strings.add "readlinkat"  [(to_consume (Some 0) 1)]
     |> Util.Strings.add "removexattr" [(to_consume None 0)]
@@ -321,6 +331,13 @@ module Make (T : ToolParserType) = struct
     |> Util.Strings.add "writev"      [to_nop]
 
 
+  (* strace reports the system calls that we model, among those of the
+     specification of mkcheck. write and writev carry the debug messages
+     of the tools. *)
+  let syscalls =
+    List.filter (fun name -> Util.Strings.mem name parsers) Syscall_spec.names
+
+
   let should_ignore trace_line =
     Util.check_prefix "+++" trace_line
 
@@ -563,4 +580,212 @@ module Make (T : ToolParserType) = struct
     match parse_lines (open_in filename) debug_trace_file with
     | traces                  -> traces
     | exception Sys_error msg -> raise (Error (GenericError, Some msg))
+
+
+  (* The binary trace of mkcheck. Records start with an opcode,
+     the pid and the name of the system call. Integers are 32-bit
+     big-endian and paths are prefixed by their length. *)
+  let binary_magic = "BFSIR001"
+
+
+  let op_consume    = 1
+  let op_produce    = 2
+  let op_del        = 3
+  let op_chdir      = 4
+  let op_newproc    = 5
+  let op_link       = 6
+  let op_rename     = 7
+  let op_begin_task = 8
+  let op_end_task   = 9
+  let op_marker     = 10
+
+
+  type binary_record =
+    | Record of Syntax.trace list
+    | Stop of int
+    | Eof
+
+
+  (* The binary trace is read either from a channel or
+     from the shared-memory ring of mkcheck. *)
+  type binary_source =
+    {read_byte: unit -> int;
+     read_int: unit -> int;
+     read_string: int -> string;
+     close_source: unit -> unit;
+    }
+
+
+  let channel_source chan =
+    {read_byte = (fun () -> input_byte chan);
+     read_int = (fun () -> input_binary_int chan);
+     read_string = really_input_string chan;
+     close_source = (fun () -> close_in chan);
+    }
+
+
+  let ring_source ring =
+    {read_byte = (fun () -> Ir_ring.input_byte ring);
+     read_int = (fun () -> Ir_ring.input_binary_int ring);
+     read_string = Ir_ring.really_input_string ring;
+     close_source = (fun () -> Ir_ring.close ring);
+    }
+
+
+  let read_binary_string src =
+    src.read_string (src.read_int ())
+
+
+  let quote str =
+    "\"" ^ str ^ "\""
+
+
+  let to_binary_sdesc syscall args ret i =
+    { syscall = syscall;
+      args = args;
+      ret = ret;
+      err = None;
+      line = i;
+    }
+
+
+  let path_expr p =
+    Syntax.P (Syntax.Path p)
+
+
+  (* Statements of a record are listed in the order
+     that the text parser produces them. *)
+  let parse_binary_record src op syscall i =
+    let with_path f =
+      let p = read_binary_string src in
+      [f (path_expr p)], to_binary_sdesc syscall (quote p) "0" i
+    in
+    let with_paths f =
+      let src' = read_binary_string src in
+      let dst = read_binary_string src in
+      f src' dst, to_binary_sdesc syscall (quote src' ^ ", " ^ quote dst) "0" i
+    in
+    let with_marker f =
+      let line = read_binary_string src in
+      (if T.stop_parser line then [] else [f line]),
+      to_binary_sdesc syscall (quote line) "0" i
+    in
+    match op with
+    | op when op = op_consume -> with_path (fun e -> Syntax.Consume e)
+    | op when op = op_produce -> with_path (fun e -> Syntax.Produce e)
+    | op when op = op_del     -> with_path (fun e -> Syntax.Del e)
+    | op when op = op_chdir   -> with_path (fun e -> Syntax.Let (Syntax.CWD, e))
+    | op when op = op_newproc ->
+      let pid = src.read_int () |> string_of_int in
+      [Syntax.Newproc pid], to_binary_sdesc syscall "" pid i
+    | op when op = op_link    ->
+      with_paths (fun src dst ->
+        match syscall with
+        | "symlink" | "symlinkat" -> [Syntax.Produce (path_expr dst)]
+        | _ -> [
+            Syntax.Consume (path_expr src);
+            Syntax.Produce (path_expr dst);
+          ])
+    | op when op = op_rename  ->
+      with_paths (fun src dst -> [
+          Syntax.Produce (path_expr dst);
+          Syntax.Del (path_expr src);
+        ])
+    | op when op = op_begin_task || op = op_end_task || op = op_marker ->
+      with_marker (fun line -> T.model_marker line)
+    | _ ->
+      make_parser_error
+        ("opcode " ^ string_of_int op)
+        i
+        (Some "Unknown record in binary trace")
+
+
+  let parse_binary_traces src i =
+    match src.read_byte () with
+    | exception End_of_file -> Eof
+    | op ->
+      try
+        let pid = src.read_int () |> string_of_int in
+        let syscall = src.read_string (src.read_byte ()) in
+        let traces, sdesc = parse_binary_record src op syscall i in
+        (* The tool may outlive the build, so we stop at its last marker. *)
+        if op = op_marker && T.stop_parser sdesc.args
+        then Stop i
+        else Record (List.map (fun trace -> (pid, (trace, sdesc))) traces)
+      with End_of_file ->
+        make_parser_error "" i (Some "Truncated binary trace")
+
+
+  let write_binary_trace out traces =
+    match out with
+    | None     -> ()
+    | Some out ->
+      List.iter (fun (pid, trace) ->
+        Printf.fprintf out "%s %s\n" pid (Syntax.string_of_trace trace)) traces
+
+
+  let parse_binary src debug_trace_file =
+    let trace_out =
+      match debug_trace_file with
+      | Some trace_file -> Some (open_out trace_file)
+      | None            -> None
+    in
+    let close () =
+      src.close_source ();
+      close_trace_out trace_out
+    in
+    let magic =
+      try src.read_string (String.length binary_magic) with
+      | End_of_file -> ""
+      | Error v     -> close (); raise (Error v)
+    in
+    if not (String.equal magic binary_magic)
+    then
+      begin
+        close ();
+        make_error GenericError (Some "Not a binary trace of mkcheck")
+      end;
+    (* Like in text traces, i starts from 1, so the first record
+       initialises the root process. *)
+    let rec _next_trace traces i () =
+      match traces with
+      | [] -> (
+        match parse_binary_traces src i with
+        | Record traces ->
+          write_binary_trace trace_out traces;
+          _next_trace traces (i + 1) ()
+        | Stop i ->
+          close ();
+          Stream (dummy_statement (Syntax.End_task "") i, fun () -> Empty)
+        | Eof ->
+          close ();
+          Empty
+        | exception Error v ->
+          close ();
+          raise (Error v)
+        | exception v ->
+          close ();
+          let msg = Printexc.to_string v in
+          raise (Error (InternalError, Some msg)))
+      | trace :: traces' ->
+        Stream (trace, _next_trace traces' i)
+    in _next_trace [] 1 ()
+
+
+  let parse_binary_fd debug_trace_file fd =
+    match
+      parse_binary (channel_source (Unix.in_channel_of_descr fd)) debug_trace_file
+    with
+    | traces                  -> traces
+    | exception Sys_error msg -> raise (Error (GenericError, Some msg))
+
+
+  let parse_binary_file debug_trace_file filename =
+    match parse_binary (channel_source (open_in_bin filename)) debug_trace_file with
+    | traces                  -> traces
+    | exception Sys_error msg -> raise (Error (GenericError, Some msg))
+
+
+  let parse_binary_ring debug_trace_file ring =
+    parse_binary (ring_source ring) debug_trace_file
 end
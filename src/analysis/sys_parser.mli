@@ -26,6 +26,10 @@ module type ToolParserType =
     (** This function identifies and model the points where
       the execution of a certain build task begins or ends. *)
 
+    val model_marker : string -> Syntax.statement
+    (** Like [model_syscall], but for a marker line of the tool
+      that was decoded by the tracer (see [parse_binary_fd]). *)
+
     val stop_parser : string -> bool
     (** This function checks whether a certain build has terminated.
 
@@ -35,6 +39,10 @@ module type ToolParserType =
 
 module type S =
   sig
+      val syscalls : string list
+      (** The system calls that the parser models, in the order of
+          mkcheck-sbuild/syscalls.def. strace traces exactly these. *)
+
       val parse_trace_fd :
         string option
         -> Unix.file_descr
@@ -56,6 +64,36 @@ module type S =
         For memory efficiency and in order to handle large files of
         execution traces, every line of the file is parsed only when it
         is needed (i.e. only when the resulting trace is used). *)
+
+      val parse_binary_fd :
+        string option
+        -> Unix.file_descr
+        -> Syntax.trace Syntax.stream
+      (** Reads the binary trace emitted by mkcheck (see MKCHECK_IR)
+          from a file descriptor and produces a stream of traces.
+
+          The tracer has already resolved every path, so the statements
+          need no regex matching and no stitching of interrupted
+          system calls. Like [parse_trace_fd], this enables online
+          analysis through a pipe. *)
+
+      val parse_binary_file :
+        string option
+        -> string
+        -> Syntax.trace Syntax.stream
+      (** Parses a file holding the binary trace emitted by mkcheck
+          and produces a stream of traces. *)
+
+      val parse_binary_ring :
+        string option
+        -> Ir_ring.t
+        -> Syntax.trace Syntax.stream
+      (** Reads the binary trace that mkcheck publishes through a
+          shared-memory ring (see MKCHECK_IR_RING) and produces
+          a stream of traces.
+
+          The tracer never waits for the analysis: batches that do
+          not fit in the ring are spilled to disk and read from there. *)
   end
 
 
@@ -17,6 +17,7 @@
 
 let gradle_msg = "##GRADLE##[ ]\\(.*\\)"
 let gradle_regex =  Str.regexp ("write[v]?([12][0-9][0-9],[ ]+\"" ^ gradle_msg ^ "\".*")
+let marker_regex = Str.regexp gradle_msg
 let regex_group = 1
 
 
@@ -35,20 +36,36 @@ let replace_spaces str =
   Str.global_replace regex " " str
 
 
+let model_message gradle_line =
+  match Core.String.split_on_chars ~on: [ ' ' ] gradle_line with
+  | "newTask" :: _           -> Syntax.Nop
+  | [ "Begin"; t; ]          -> Syntax.Begin_task t
+  | [ "End"; t; ]            -> Syntax.End_task t
+  | [ "dependsOn"; t1; t2; ] -> Syntax.DependsOn (t1, t2)
+  | [ "consumes"; t; p; ]    -> Syntax.Input (t, p |> replace_spaces)
+  | [ "produces"; t; p; ]    -> Syntax.Output (t, p |> replace_spaces)
+  | _                        ->
+    raise (Errors.Error (Errors.GenericError, Some "Unable to parse line"))
+
+
 let model_syscall syscall_line =
   if Str.string_match gradle_regex syscall_line 0
   then
     try
-      let gradle_line = Str.matched_group regex_group syscall_line in
-      match Core.String.split_on_chars ~on: [ ' ' ] gradle_line with
-      | "newTask" :: _           -> Syntax.Nop
-      | [ "Begin"; t; ]          -> Syntax.Begin_task t
-      | [ "End"; t; ]            -> Syntax.End_task t
-      | [ "dependsOn"; t1; t2; ] -> Syntax.DependsOn (t1, t2)
-      | [ "consumes"; t; p; ]    -> Syntax.Input (t, p |> replace_spaces)
-      | [ "produces"; t; p; ]    -> Syntax.Output (t, p |> replace_spaces)
-      | _                        ->
-        raise (Errors.Error (Errors.GenericError, Some "Unable to parse line"))
+      syscall_line
+      |> Str.matched_group regex_group
+      |> model_message
+    with Not_found -> Syntax.Nop
+  else Syntax.Nop
+
+
+let model_marker line =
+  if Str.string_match marker_regex line 0
+  then
+    try
+      line
+      |> Str.matched_group regex_group
+      |> model_message
     with Not_found -> Syntax.Nop
   else Syntax.Nop
 
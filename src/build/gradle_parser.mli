@@ -27,6 +27,10 @@ val model_syscall : string -> Syntax.statement
   In the context of Gradle, those points correspond to writes
   a file descriptor greater than 100. *)
 
+val model_marker : string -> Syntax.statement
+(** Like [model_syscall], but for a marker line written by the
+  instrumented Gradle build and decoded by the tracer. *)
+
 val stop_parser : string -> bool
 (** This function checks whether the execution of a Gradle script ends.
   
@@ -17,6 +17,7 @@
 
 let make_msg = "##MAKE##[ ]\\(.*\\)"
 let make_regex =  Str.regexp ("write[v]?(1,[ ]+\"" ^ make_msg ^ "\\\\n\".*")
+let marker_regex = Str.regexp make_msg
 let regex_group = 1
 
 let stop_pattern = "##MAKE## BUILD ENDED"
@@ -27,24 +28,40 @@ let is_tool_debug_msg syscall_line =
     Util.check_prefix "write(1," syscall_line
 
 
+let model_message msg =
+  match
+    msg
+    |> Core.String.strip ~drop: (fun x -> x = '\n')
+    |> Core.String.split_on_chars ~on: [ ' ' ]
+  with
+  | [ "End" ]       -> Syntax.End_task ""
+  | [ "Begin"; t; ] -> (
+    let len = String.length t in
+    match String.get t (len - 1) with
+    | ':' -> Syntax.Begin_task Syntax.main_block
+    | _   -> Syntax.Begin_task t)
+  | _               ->
+    raise (Errors.Error (Errors.GenericError, Some "Unable to parse line"))
+
+
 let model_syscall syscall_line =
   if Str.string_match make_regex syscall_line 0
   then
     try
-      match
-        syscall_line
-        |> Str.matched_group regex_group
-        |> Core.String.strip ~drop: (fun x -> x = '\n')
-        |> Core.String.split_on_chars ~on: [ ' ' ]
-      with
-      | [ "End" ]       -> Syntax.End_task ""
-      | [ "Begin"; t; ] -> (
-        let len = String.length t in
-        match String.get t (len - 1) with
-        | ':' -> Syntax.Begin_task Syntax.main_block
-        | _   -> Syntax.Begin_task t)
-      | _               ->
-        raise (Errors.Error (Errors.GenericError, Some "Unable to parse line"))
+      syscall_line
+      |> Str.matched_group regex_group
+      |> model_message
+    with Not_found -> Syntax.Nop
+  else Syntax.Nop
+
+
+let model_marker line =
+  if Str.string_match marker_regex line 0
+  then
+    try
+      line
+      |> Str.matched_group regex_group
+      |> model_message
     with Not_found -> Syntax.Nop
   else Syntax.Nop
 
@@ -24,6 +24,10 @@ val model_syscall : string -> Syntax.statement
 (** This function identifies and model the points where
   the application of a certain Make task begins or ends. *)
 
+val model_marker : string -> Syntax.statement
+(** Like [model_syscall], but for a marker line written by the
+  instrumented Make build and decoded by the tracer. *)
+
 val stop_parser : string -> bool
 (** This function checks whether the execution of a Make script ends.
   
@@ -0,0 +1,277 @@
+(*
+ * Copyright (c) 2018-2020 Thodoris Sotiropoulos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *)
+
+
+(* The layout follows mkcheck-sbuild/ring.h: a page with the header,
+   made of 64-bit slots, followed by the data area. Messages start
+   with their 32-bit length and kind and are padded to 8 bytes. *)
+let magic = 0x3130474e49524b4dL
+let data_offset = 4096
+
+let slot_magic           = 0
+let slot_capacity        = 1
+let slot_head            = 2
+let slot_tail            = 3
+let slot_closed          = 4
+let slot_batches         = 5
+let slot_full            = 6
+let slot_spilled_batches = 7
+let slot_spilled_bytes   = 8
+let slot_peak            = 9
+
+let kind_data  = 1
+let kind_spill = 2
+let kind_wrap  = 3
+
+
+type mapping =
+  {header: (int64, Bigarray.int64_elt, Bigarray.c_layout) Bigarray.Array1.t;
+   data: (char, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t;
+   capacity: int;
+  }
+
+
+type t =
+  {path: string;
+   doorbell: Unix.file_descr;
+   scratch: Bytes.t;
+   mutable mapping: mapping option;
+   mutable spill: Unix.file_descr option;
+   mutable hung_up: bool;
+   mutable buf: Bytes.t;
+   mutable pos: int;
+   mutable len: int;
+  }
+
+
+type stats =
+  {batches: int;
+   full: int;
+   spilled_batches: int;
+   spilled_bytes: int;
+   peak: int;
+  }
+
+
+let ring_error msg =
+  raise (Errors.Error (Errors.GenericError, Some msg))
+
+
+let open_ring path doorbell =
+  {path = path;
+   doorbell = doorbell;
+   scratch = Bytes.create 4096;
+   mapping = None;
+   spill = None;
+   hung_up = false;
+   buf = Bytes.empty;
+   pos = 0;
+   len = 0;
+  }
+
+
+let get_slot m slot =
+  Int64.to_int (Bigarray.Array1.get m.header slot)
+
+
+let get_u32 m pos =
+  let byte i = Char.code (Bigarray.Array1.get m.data (pos + i)) in
+  (byte 0) lor ((byte 1) lsl 8) lor ((byte 2) lsl 16) lor ((byte 3) lsl 24)
+
+
+let get_u64 m pos =
+  (get_u32 m pos) lor ((get_u32 m (pos + 4)) lsl 32)
+
+
+(* Drains the doorbell, so that the next wait blocks until
+   the tracer publishes again. *)
+let ring_doorbell ring timeout =
+  match Unix.select [ring.doorbell] [] [] timeout with
+  | [], _, _ -> ()
+  | _ ->
+    if Unix.read ring.doorbell ring.scratch 0 (Bytes.length ring.scratch) = 0
+    then ring.hung_up <- true
+  | exception Unix.Unix_error (Unix.EINTR, _, _) -> ()
+
+
+(* The tracer rings the doorbell once the ring is ready,
+   so the file is not mapped before, as it is still truncated. *)
+let map_ring ring =
+  let rec _wait () =
+    match Unix.read ring.doorbell ring.scratch 0 1 with
+    | 0 -> ring.hung_up <- true
+    | _ -> ()
+    | exception Unix.Unix_error (Unix.EINTR, _, _) -> _wait ()
+  in
+  if not ring.hung_up then _wait ();
+  if ring.hung_up then raise End_of_file;
+  let fd =
+    try Unix.openfile ring.path [Unix.O_RDWR] 0
+    with Unix.Unix_error (err, _, _) -> ring_error (Unix.error_message err)
+  in
+  let map kind pos len =
+    Unix.map_file fd ~pos: (Int64.of_int pos) kind Bigarray.c_layout true [|len|]
+    |> Bigarray.array1_of_genarray
+  in
+  let size = (Unix.fstat fd).Unix.st_size in
+  if size <= data_offset
+  then (Unix.close fd; ring_error "Not a ring of mkcheck");
+  let header = map Bigarray.int64 0 (data_offset / 8) in
+  if Bigarray.Array1.get header slot_magic <> magic
+  then (Unix.close fd; ring_error "Not a ring of mkcheck");
+  let capacity = Int64.to_int (Bigarray.Array1.get header slot_capacity) in
+  let m = {
+    header = header;
+    data = map Bigarray.char data_offset capacity;
+    capacity = capacity;
+  } in
+  Unix.close fd;
+  ring.mapping <- Some m;
+  m
+
+
+let read_spill ring offset len =
+  let fd =
+    match ring.spill with
+    | Some fd -> fd
+    | None    ->
+      let fd = Unix.openfile (ring.path ^ ".spill") [Unix.O_RDONLY] 0 in
+      ring.spill <- Some fd;
+      fd
+  in
+  ignore (Unix.lseek fd offset Unix.SEEK_SET);
+  let rec _read off =
+    if off < len then
+      match Unix.read fd ring.buf off (len - off) with
+      | 0 -> ring_error "Truncated spill file of ring"
+      | n -> _read (off + n)
+  in
+  _read 0
+
+
+(* Copies the next message out of the ring, so that its space
+   is released to the tracer right away. *)
+let rec next_message ring m =
+  let tail = get_slot m slot_tail in
+  let is_empty () = get_slot m slot_head = tail in
+  if is_empty () then
+    begin
+      (* The head is read again, as the tracer publishes before closing. *)
+      if (get_slot m slot_closed <> 0 && is_empty ()) || ring.hung_up
+      then raise End_of_file;
+      (* The timeout only guards against a lost wake-up. *)
+      ring_doorbell ring 0.1;
+      next_message ring m
+    end
+  else
+    let pos = tail mod m.capacity in
+    let len = get_u32 m pos in
+    let kind = get_u32 m (pos + 4) in
+    let grow len =
+      if Bytes.length ring.buf < len
+      then ring.buf <- Bytes.create len;
+      ring.pos <- 0;
+      ring.len <- len
+    in
+    if kind = kind_data then
+      begin
+        grow len;
+        for i = 0 to len - 1 do
+          Bytes.unsafe_set ring.buf i (Bigarray.Array1.get m.data (pos + 8 + i))
+        done
+      end
+    else if kind = kind_spill then
+      begin
+        let len = get_u64 m (pos + 16) in
+        grow len;
+        read_spill ring (get_u64 m (pos + 8)) len
+      end
+    else if kind <> kind_wrap then
+      ring_error "Corrupted ring";
+    Bigarray.Array1.set m.header slot_tail
+      (Int64.of_int (tail + 8 + ((len + 7) land (lnot 7))));
+    if kind = kind_wrap then next_message ring m
+
+
+let refill ring =
+  let m =
+    match ring.mapping with
+    | Some m -> m
+    | None   -> map_ring ring
+  in
+  ring.pos <- 0;
+  ring.len <- 0;
+  while ring.len = 0 do
+    next_message ring m
+  done
+
+
+let input_byte ring =
+  if ring.pos >= ring.len then refill ring;
+  let c = Bytes.get ring.buf ring.pos in
+  ring.pos <- ring.pos + 1;
+  Char.code c
+
+
+let input_binary_int ring =
+  let b0 = input_byte ring in
+  let b1 = input_byte ring in
+  let b2 = input_byte ring in
+  let b3 = input_byte ring in
+  let v = (b0 lsl 24) lor (b1 lsl 16) lor (b2 lsl 8) lor b3 in
+  if b0 land 0x80 <> 0 then v - (1 lsl 32) else v
+
+
+let really_input_string ring n =
+  let out = Bytes.create n in
+  let rec _copy off =
+    if off < n then
+      begin
+        if ring.pos >= ring.len then refill ring;
+        let len = min (ring.len - ring.pos) (n - off) in
+        Bytes.blit ring.buf ring.pos out off len;
+        ring.pos <- ring.pos + len;
+        _copy (off + len)
+      end
+  in
+  _copy 0;
+  Bytes.unsafe_to_string out
+
+
+let stats ring =
+  match ring.mapping with
+  | None   -> None
+  | Some m ->
+    Some {
+      batches = get_slot m slot_batches;
+      full = get_slot m slot_full;
+      spilled_batches = get_slot m slot_spilled_batches;
+      spilled_bytes = get_slot m slot_spilled_bytes;
+      peak = get_slot m slot_peak;
+    }
+
+
+let close ring =
+  let remove path =
+    try Sys.remove path with Sys_error _ -> ()
+  in
+  (match ring.spill with
+   | Some fd -> Unix.close fd
+   | None    -> ());
+  ring.spill <- None;
+  (try Unix.close ring.doorbell with Unix.Unix_error _ -> ());
+  remove ring.path;
+  remove (ring.path ^ ".spill")
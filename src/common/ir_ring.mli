@@ -0,0 +1,59 @@
+(*
+ * Copyright (c) 2018-2020 Thodoris Sotiropoulos
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *)
+
+
+type t
+(** The consumer side of the shared-memory ring through which
+    mkcheck publishes its binary trace (see MKCHECK_IR_RING). *)
+
+
+type stats =
+  {batches: int; (** Number of batches published by the tracer. *)
+   full: int; (** Number of batches that found the ring full. *)
+   spilled_batches: int; (** Number of batches written to the spill file. *)
+   spilled_bytes: int; (** Number of bytes written to the spill file. *)
+   peak: int; (** Largest number of bytes waiting in the ring. *)
+  }
+(** Statistics about the backpressure of the ring. *)
+
+
+val open_ring : string -> Unix.file_descr -> t
+(** Opens the ring at the given path. The tracer creates the ring
+    and writes to the given file descriptor (the doorbell) whenever
+    it publishes a batch, so the ring is mapped lazily. *)
+
+
+val input_byte : t -> int
+(** Reads a byte from the ring, waiting for the tracer if needed.
+    Raises [End_of_file] when the tracer has closed the ring. *)
+
+
+val input_binary_int : t -> int
+(** Reads a 32-bit big-endian integer, like [Stdlib.input_binary_int]. *)
+
+
+val really_input_string : t -> int -> string
+(** Reads a string of the given length, like
+    [Stdlib.really_input_string]. *)
+
+
+val stats : t -> stats option
+(** Returns the statistics of the ring, if it has been mapped. *)
+
+
+val close : t -> unit
+(** Closes the doorbell and removes the files of the ring.
+    The mapping goes away once it is collected. *)
@@ -25,6 +25,11 @@ type mode =
   | Offline
 
 
+type tracer =
+  | Strace
+  | Mkcheck
+
+
 module type ToolType =
   sig
     type tool_options
@@ -51,6 +56,7 @@ module type S =
        print_stats: bool;
        trace_file: string option;
        dump_tool_out: string option;
+       tracer: tracer;
       }
 
     type tool_options
@@ -63,55 +69,7 @@ module type S =
 
 module Make(T: ToolType) = struct
 
-  let syscalls = [
-    "access";
-    "chdir";
-    "chmod";
-    "chown";
-    "clone";
-    "close";
-    "dup";
-    "dup2";
-    "dup3";
-    "execve";
-    "fchdir";
-    "fchmodat";
-    "fchownat";
-    "fcntl";
-    "fork";
-    "getxattr";
-    "getcwd";
-    "lchown";
-    "lgetxattr";
-    "lremovexattr";
-    "lsetxattr";
-    "lstat";
-    "link";
-    "linkat";
-    "mkdir";
-    "mkdirat";
-    "mknod";
-    "open";
-    "openat";
-    "readlink";
-    "readlinkat";
-    "removexattr";
-    "rename";
-    "renameat";
-    "rmdir";
-    "stat";
-    "statfs";
-    "symlink";
-    "symlinkat";
-    "unlink";
-    "unlinkat";
-    "utime";
-    "utimensat";
-    "utimes";
-    "vfork";
-    "write";
-    "writev";
-  ]
+  let syscalls = T.SysParser.syscalls
 
   type generic_options =
     {mode: mode;
@@ -120,6 +78,7 @@ module Make(T: ToolType) = struct
      print_stats: bool;
      trace_file: string option;
      dump_tool_out: string option;
+     tracer: tracer;
     }
 
 
@@ -129,6 +88,7 @@ module Make(T: ToolType) = struct
   type read_point =
     | File of string
     | FileDesc of Unix.file_descr
+    | Ring of Ir_ring.t
 
 
   let child_failed_status_code = 255
@@ -142,11 +102,8 @@ module Make(T: ToolType) = struct
     Printf.sprintf "%s: %s (%s)" (Unix.error_message err) call params
 
 
-  let trace_execution generic_options tool_options input =
-    let tool_cmd = T.construct_command tool_options in
-    let prog = "/usr/bin/strace" in
-    let fd_out = input |> Fd_send_recv.int_of_fd |> string_of_int in
-    let strace_cmd = [|
+  let strace_command fd_out =
+    "/usr/bin/strace", [|
       "strace";
       "-s";
       "300";
@@ -155,8 +112,35 @@ module Make(T: ToolType) = struct
       "-o";
       ("/dev/fd/" ^ fd_out);
       "-f"; |]
+
+
+  let mkcheck_command fd_out ring =
+    (* mkcheck writes the statements of BuildFS to the file named
+       by MKCHECK_IR, so there is nothing left to parse.
+       If MKCHECK_IR_RING is set, the statements go through a ring
+       mapped there instead, and the file only wakes us up.
+       The instrumented tool writes its markers to the file named by
+       MKCHECK_TASKS, and mkcheck groups the statements by task. *)
+    Unix.putenv "MKCHECK_IR" ("/dev/fd/" ^ fd_out);
+    (match ring with
+     | Some ring -> Unix.putenv "MKCHECK_IR_RING" ring
+     | None      -> ());
+    Unix.putenv "MKCHECK_TASKS" (Filename.temp_file "buildfs" ".tasks");
+    "/usr/local/bin/mkcheck", [|
+      "mkcheck";
+      "--output=/dev/null";
+      "--"; |]
+
+
+  let trace_execution generic_options tool_options input ring =
+    let tool_cmd = T.construct_command tool_options in
+    let fd_out = input |> Fd_send_recv.int_of_fd |> string_of_int in
+    let prog, tracer_cmd =
+      match generic_options.tracer with
+      | Strace  -> strace_command fd_out
+      | Mkcheck -> mkcheck_command fd_out ring
     in
-    let cmd = Array.append strace_cmd tool_cmd in 
+    let cmd = Array.append tracer_cmd tool_cmd in 
     try
       print_endline ("\x1b[0;32mInfo: Start tracing command: "
         ^ (String.concat " " (Array.to_list tool_cmd)) ^ " ...\x1b[0m");
@@ -172,7 +156,7 @@ module Make(T: ToolType) = struct
       ignore (Unix.execv prog cmd);
       exit 254; (* We should never reach here. *)
     with Unix.Unix_error (err, call, params) ->
-      (* Maybe strace is not installed in the system.
+      (* Maybe the tracer is not installed in the system.
         So, we pass the exception to err to the pipe
         so that it can be read by the parent process. *)
       let msg = string_of_unix_err err call params in
@@ -185,15 +169,27 @@ module Make(T: ToolType) = struct
 
   let analyze_trace_internal read_p debug_trace generic_options tool_options =
     let stats, aout =
-      match read_p with
-      | File p     ->
+      match read_p, generic_options.tracer with
+      | File p, Strace      ->
         p
         |> T.SysParser.parse_trace_file debug_trace
         |> T.TraceAnalyzer.analyze_traces (Stats.init_stats ())
-      | FileDesc p ->
+      | FileDesc p, Strace  ->
         p
         |> T.SysParser.parse_trace_fd debug_trace
         |> T.TraceAnalyzer.analyze_traces (Stats.init_stats ())
+      | File p, Mkcheck     ->
+        p
+        |> T.SysParser.parse_binary_file debug_trace
+        |> T.TraceAnalyzer.analyze_traces (Stats.init_stats ())
+      | FileDesc p, Mkcheck ->
+        p
+        |> T.SysParser.parse_binary_fd debug_trace
+        |> T.TraceAnalyzer.analyze_traces (Stats.init_stats ())
+      | Ring p, _           ->
+        p
+        |> T.SysParser.parse_binary_ring debug_trace
+        |> T.TraceAnalyzer.analyze_traces (Stats.init_stats ())
     in
     T.FaultDetector.detect_faults
       ~print_stats: generic_options.print_stats
@@ -201,18 +197,50 @@ module Make(T: ToolType) = struct
       stats generic_options.graph_file tool_options aout
 
 
+  let print_ring_stats ring =
+    match Ir_ring.stats ring with
+    | None       -> ()
+    | Some stats ->
+      let print_entry x y =
+        print_endline ("\x1b[0;32m" ^ x ^ ": " ^ (string_of_int y) ^ "\x1b[0m")
+      in
+      begin
+        print_entry "Ring batches" stats.Ir_ring.batches;
+        print_entry "Ring batches found full" stats.Ir_ring.full;
+        print_entry "Ring spilled batches" stats.Ir_ring.spilled_batches;
+        print_entry "Ring spilled bytes" stats.Ir_ring.spilled_bytes;
+        print_entry "Ring peak bytes" stats.Ir_ring.peak;
+      end
+
+
   let online_analysis generic_options tool_options =
     let output, input = Unix.pipe () in
+    (* mkcheck publishes its trace through a shared-memory ring,
+       so that a parallel build is not held back by the pipe;
+       the pipe only serves as the doorbell of the ring. *)
+    let ring =
+      match generic_options.tracer with
+      | Strace  -> None
+      | Mkcheck -> Some (Filename.temp_file "buildfs" ".ring")
+    in
     (* We create a child process that is responsible for invoking
-     strace and run the build script in parallel. *)
+     the tracer and run the build script in parallel. *)
     match Unix.fork () with
     | 0   ->
       Unix.close output;
-      trace_execution generic_options tool_options input
+      trace_execution generic_options tool_options input ring
     | pid -> (
       Unix.close input;
+      let read_p =
+        match ring with
+        | None      -> FileDesc output
+        | Some ring -> Ring (Ir_ring.open_ring ring output)
+      in
       analyze_trace_internal
-        (FileDesc output) generic_options.trace_file generic_options tool_options;
+        read_p generic_options.trace_file generic_options tool_options;
+      (match read_p with
+       | Ring ring when generic_options.print_stats -> print_ring_stats ring
+       | _ -> ());
       try
         Unix.kill pid Sys.sigkill;
         Unix.close output;
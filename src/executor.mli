@@ -28,6 +28,12 @@ type mode =
     It's either online or offline. *)
 
 
+type tracer =
+  | Strace (** Trace with strace and parse its textual output. *)
+  | Mkcheck (** Trace with mkcheck and read its binary trace. *)
+(** Represents the tool that traces the build. *)
+
+
 module type ToolType =
   sig
     type tool_options
@@ -62,6 +68,7 @@ module type S =
        print_stats: bool; (** Print statistics about analysis. *)
        trace_file: string option; (** Path to system call trace file. *)
        dump_tool_out: string option; (** Dump tool output to this file. *)
+       tracer: tracer; (** Tool that traces the build. *)
       }
 
 
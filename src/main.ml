@@ -52,6 +52,16 @@ let mode_of_string = function
     end
 
 
+let tracer_of_string = function
+  | "strace"  -> Executor.Strace
+  | "mkcheck" -> Executor.Mkcheck
+  | _         ->
+    begin
+      Printf.eprintf "Tracer must be either 'strace' or 'mkcheck'";
+      exit 1;
+    end
+
+
 let gradle_tool =
   let open Core.Command.Let_syntax in
   Core.Command.basic
@@ -81,6 +91,9 @@ let gradle_tool =
     and print_stats =
       flag "print-stats" (no_arg)
       ~doc: "Print stats about execution and analysis"
+    and tracer =
+      flag "tracer" (optional_with_default Executor.Strace (Arg_type.create tracer_of_string))
+      ~doc: "Tool for tracing the build; either strace (default) or mkcheck"
     in
     fun () ->
       let module GradleExecutor = Executor.Make(Gradle) in
@@ -98,7 +111,8 @@ let gradle_tool =
          GradleExecutor.mode = mode;
          GradleExecutor.graph_file = graph_file;
          GradleExecutor.graph_format = graph_format;
-         GradleExecutor.print_stats = print_stats;}
+         GradleExecutor.print_stats = print_stats;
+         GradleExecutor.tracer = tracer;}
       in
       match Gradle.validate_options generic_options.mode gradle_options with
       | Executor.Err err ->
@@ -144,6 +158,9 @@ let make_tool =
     and print_stats =
       flag "print-stats" (no_arg)
       ~doc: "Print stats about execution and analysis"
+    and tracer =
+      flag "tracer" (optional_with_default Executor.Strace (Arg_type.create tracer_of_string))
+      ~doc: "Tool for tracing the build; either strace (default) or mkcheck"
     in
     fun () ->
       let module MakeExecutor = Executor.Make(Make) in
@@ -161,7 +178,8 @@ let make_tool =
          MakeExecutor.mode = mode;
          MakeExecutor.graph_file = graph_file;
          MakeExecutor.graph_format = graph_format;
-         MakeExecutor.print_stats = print_stats;}
+         MakeExecutor.print_stats = print_stats;
+         MakeExecutor.tracer = tracer;}
       in
       match Make.validate_options generic_options.mode make_options with
       | Executor.Err err ->
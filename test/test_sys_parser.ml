@@ -0,0 +1,110 @@
+(*
+ * Copyright (c) 2018-2020 Thodoris Sotiropoulos
+ *
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *)
+
+
+open OUnit2
+
+open Buildfs
+open Syntax
+
+
+
+(* make.ir is the binary trace recorded by mkcheck (MKCHECK_IR) for
+   a Makefile with the single rule
+
+     out: in
+             cat in > out
+
+   make (pid 15351) runs the recipe through dash (15352),
+   which runs cat (15353). *)
+let trace_file = "make.ir"
+
+
+let rec to_list = function
+  | Empty               -> []
+  | Stream (trace, next) -> trace :: to_list (next ())
+
+
+let parse () =
+  Make.SysParser.parse_binary_file None trace_file |> to_list
+
+
+let has_statement traces pid syscall statement =
+  List.exists (fun (pid', (statement', sdesc)) ->
+    String.equal pid pid' &&
+    String.equal syscall sdesc.syscall &&
+    statement = statement') traces
+
+
+let describe syscall =
+  {syscall = syscall; args = ""; ret = "0"; err = None; line = 0}
+
+
+let assert_statement traces pid syscall statement =
+  assert_bool
+    (Printf.sprintf "Missing %s %s"
+      pid (string_of_trace (statement, describe syscall)))
+    (has_statement traces pid syscall statement)
+
+
+let consume p = Consume (P (Path p))
+
+
+let produce p = Produce (P (Path p))
+
+
+let test_records _ =
+  let traces = parse () in
+  assert_equal ~printer:string_of_int 42 (List.length traces);
+  match traces with
+  | (pid, (statement, sdesc)) :: _ ->
+    assert_equal ~printer:(fun x -> x) "15351" pid;
+    assert_equal ~printer:(fun x -> x) "execve" sdesc.syscall;
+    assert_equal (consume "/usr/bin/make") statement
+  | [] -> assert_failure "Empty trace"
+
+
+let test_newproc _ =
+  let traces = parse () in
+  assert_statement traces "15351" "clone" (Newproc "15352");
+  assert_statement traces "15352" "clone" (Newproc "15353")
+
+
+let test_exec _ =
+  let traces = parse () in
+  assert_statement traces "15352" "execve" (consume "/usr/bin/dash");
+  assert_statement traces "15353" "execve" (consume "/usr/bin/cat")
+
+
+let test_files _ =
+  let traces = parse () in
+  assert_statement traces "15351" "read" (consume "/tmp/irfix/Makefile");
+  assert_statement traces "15353" "copy_file_range" (consume "/tmp/irfix/in");
+  assert_statement traces "15353" "copy_file_range" (produce "/tmp/irfix/out");
+  assert_statement traces "15351" "chdir" (Let (CWD, P (Path "/tmp/irfix")))
+
+
+let suite =
+  "sys_parser" >::: [
+    "binary records" >:: test_records;
+    "binary newproc" >:: test_newproc;
+    "binary execve" >:: test_exec;
+    "binary files" >:: test_files;
+  ]
+
+
+let () =
+  run_test_tt_main suite